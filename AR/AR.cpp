@@ -16,12 +16,30 @@
 #include <algorithm>
 #include <numeric>
 #include <iomanip>
+#include <memory>
+#include <thread>
 
 // Dear ImGui (vendored under external/imgui/)
 #include "imgui.h"
 #include "backends/imgui_impl_glfw.h"
 #include "backends/imgui_impl_opengl3.h"
 
+#include "alloc_counter.h"
+#include "board_detector.h"
+#include "camera_intrinsics.h"
+#include "common/profiler.h"
+#include "common/undistort_maps.h"
+#include "frame_pipeline.h"
+#include "frame_recording.h"
+#include "frame_source.h"
+#include "gpu_timer.h"
+#include "latency_controller.h"
+#include "offscreen_target.h"
+#include "pose_estimator.h"
+#include "replay_benchmark.h"
+#include "telemetry.h"
+#include "texture_streamer.h"
+
 // Helper to load shader source from file
 static std::string loadShaderSource(const std::string &path) {
   std::ifstream file(path);
@@ -105,8 +123,218 @@ GLuint createShaderProgramWithGeom(const char *vertexSrc, const char *geomSrc,
   return program;
 }
 
-int main() {
+// Detects the board once in every frame of `input` (anything
+// cv::VideoCapture opens: a video file or an image sequence such as
+// frames/%04d.png) and runs all pose solvers over the detected corners.
+static int runPoseBenchmark(const std::string &input,
+                            const cv::Mat &cameraMatrix,
+                            const cv::Mat &distCoeffs) {
+  cv::VideoCapture cap(input);
+  if (!cap.isOpened()) {
+    std::cerr << "Cannot open " << input << "\n";
+    return -1;
+  }
+
+  BoardDetector detector(cv::Size(9, 6), 0.025f, cameraMatrix, distCoeffs);
+  DetectorSettings settings;
+  settings.pyramidLevel = 0; // full-resolution corners for every frame
+  detector.setSettings(settings);
+
+  std::vector<std::vector<cv::Point2f>> cornerSets;
+  cv::Mat frame;
+  BoardDetection detection;
+  int frames = 0;
+  while (cap.read(frame)) {
+    ++frames;
+    if (detector.detect(frame, detection))
+      cornerSets.push_back(detection.corners);
+  }
+  std::cout << "Board found in " << cornerSets.size() << " of " << frames
+            << " frames\n";
+  if (cornerSets.empty())
+    return -1;
+
+  benchmarkPoseMethods(cornerSets, detector.objectPoints(), cameraMatrix,
+                       distCoeffs, std::cout);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  const cv::String keys =
+      "{help h usage ? |   | print this message                        }"
+      "{camera c       | 0 | camera index passed to cv::VideoCapture   }"
+      "{calib          |   | camera calibration written by CameraCalibration "
+      "(out_camera_data.xml); default: built-in intrinsics }"
+      "{undistort      | false | show the camera image undistorted, through "
+      "remap maps precomputed from the calibration }"
+      "{queue          | 2 | capacity of each capture/detection queue  }"
+      "{capture        | latest | latest: grab on a thread and drop stale "
+      "frames, queue: read every frame in order }"
+      "{roi            | true | search around the previous board before "
+      "falling back to the full frame }"
+      "{roi-margin     | 0.25 | border around the predicted board region, "
+      "as a fraction of the board size }"
+      "{track          | false | follow the corners with KLT optical flow "
+      "between full detections }"
+      "{redetect       | 10 | run the full detector at least every N frames "
+      "while tracking }"
+      "{motion-gate    | false | reuse the last corners and pose while the "
+      "image around the board does not change }"
+      "{idle-interval  | 10 | with --motion-gate, search an unchanged frame "
+      "without a board only every N frames }"
+      "{budget         | 0 | detection time budget per frame in ms: adapt "
+      "pyramid, ROI, flags, cornerSubPix and tracking to stay inside it "
+      "(0 = off) }"
+      "{pyramid        | -1 | search on a 1/2^N downscaled image (0, 1, 2), "
+      "-1 picks N from the board size in the previous frame }"
+      "{pose           | iterative | pose solver: iterative, ippe, "
+      "homography or refine }"
+      "{warm-start     | true | seed the pose solver with the previous pose }"
+      "{pose-bench     |   | compare pose solvers on the frames of this video "
+      "or image sequence, then exit }"
+      "{alloc-check    | 0 | after N frames, exit with an error as soon as a "
+      "render loop iteration allocates; 0 only reports }"
+      "{upload         | pbo | background texture upload: direct "
+      "(glTexSubImage2D from the frame) or pbo (BGRA pixel buffer ring) }"
+      "{convert        | shader | where BGR -> RGB and the vertical flip for "
+      "OpenGL happen: cpu (detection thread) or shader }"
+      "{log            | ar_log.bin | binary telemetry file, converted to "
+      "ar_log.csv on exit }"
+      "{log-to-csv     |   | convert this binary telemetry file to ar_log.csv "
+      "and exit }"
+      "{profile        | false | time every pipeline stage and print a "
+      "per-stage report on exit }"
+      "{replay         |   | run headless on this video, image sequence "
+      "(frames/%04d.png) or still image and print throughput and per-stage "
+      "latency }"
+      "{replay-frames  | 0 | frames to play with --replay or --input, looping "
+      "the input as needed; 0 plays it once }"
+      "{input          |   | show this recording, video, image sequence or "
+      "still image instead of the camera; every frame is rendered once, in "
+      "order }"
+      "{realtime       | false | play an --input recording at its recorded "
+      "pace instead of as fast as possible }"
+      "{record         |   | save every captured frame losslessly to this "
+      "file, for --input and --replay }"
+      "{offscreen      | none | render into a framebuffer object without a "
+      "window: none, egl (surfaceless) or osmesa }"
+      "{readback       |   | with --offscreen, save every --readback-every-th "
+      "frame to this directory before the GUI is drawn }"
+      "{readback-every | 30 | frame interval for --readback and --golden }"
+      "{golden         |   | with --offscreen, compare the read-back frames "
+      "with the images of the same name in this directory }"
+      "{trace          |   | write a Chrome trace-event JSON of every stage "
+      "to this file on exit (chrome://tracing, ui.perfetto.dev) }";
+  cv::CommandLineParser parser(argc, argv, keys);
+  parser.about("AR cube on a 9x6 checkerboard.\n"
+               "Usage: AR [--camera=<index>] [--queue=<depth>] "
+               "[--capture=latest|queue]\n"
+               "       AR --replay=<video|image> [--replay-frames=<n>]");
+  if (parser.has("help")) {
+    parser.printMessage();
+    return 0;
+  }
+  int cameraIndex = parser.get<int>("camera");
+  std::string calibPath = parser.get<std::string>("calib");
+  bool undistortBackground = parser.get<bool>("undistort");
+  int queueDepth = std::max(1, parser.get<int>("queue"));
+  std::string captureMode = parser.get<std::string>("capture");
+  DetectorSettings detectorSettings;
+  detectorSettings.roiSearch = parser.get<bool>("roi");
+  // Same range as the GUI slider; a negative margin shrinks the ROI to nothing
+  detectorSettings.roiMargin =
+      std::min(1.0f, std::max(0.05f, parser.get<float>("roi-margin")));
+  detectorSettings.tracking = parser.get<bool>("track");
+  detectorSettings.redetectInterval = std::max(1, parser.get<int>("redetect"));
+  double budgetMs = std::max(0.0, parser.get<double>("budget"));
+  detectorSettings.motionGate = parser.get<bool>("motion-gate");
+  detectorSettings.idleInterval =
+      std::max(1, parser.get<int>("idle-interval"));
+  detectorSettings.pyramidLevel =
+      std::min(parser.get<int>("pyramid"), kMaxPyramidLevel);
+  detectorSettings.poseWarmStart = parser.get<bool>("warm-start");
+  std::string poseMethod = parser.get<std::string>("pose");
+  std::string poseBenchInput = parser.get<std::string>("pose-bench");
+  std::string replayInput = parser.get<std::string>("replay");
+  int replayFrames = std::max(0, parser.get<int>("replay-frames"));
+  std::string inputPath = parser.get<std::string>("input");
+  bool realtime = parser.get<bool>("realtime");
+  std::string recordPath = parser.get<std::string>("record");
+  std::string offscreenApi = parser.get<std::string>("offscreen");
+  std::string readbackDir = parser.get<std::string>("readback");
+  int readbackEvery = std::max(1, parser.get<int>("readback-every"));
+  std::string goldenDir = parser.get<std::string>("golden");
+  int allocCheckAfter = std::max(0, parser.get<int>("alloc-check"));
+  std::string uploadModeArg = parser.get<std::string>("upload");
+  std::string convertMode = parser.get<std::string>("convert");
+  std::string logPath = parser.get<std::string>("log");
+  std::string logToCsv = parser.get<std::string>("log-to-csv");
+  Profiler::setEnabled(parser.get<bool>("profile"));
+  std::string tracePath = parser.get<std::string>("trace");
+  if (!parser.check()) {
+    parser.printErrors();
+    return -1;
+  }
+  if (captureMode != "latest" && captureMode != "queue") {
+    std::cerr << "Unknown capture mode: " << captureMode << "\n";
+    return -1;
+  }
+  if (!parsePoseMethod(poseMethod, detectorSettings.poseMethod)) {
+    std::cerr << "Unknown pose method: " << poseMethod << "\n";
+    return -1;
+  }
+  UploadMode uploadMode;
+  if (!parseUploadMode(uploadModeArg, uploadMode)) {
+    std::cerr << "Unknown upload mode: " << uploadModeArg << "\n";
+    return -1;
+  }
+  if (convertMode != "cpu" && convertMode != "shader") {
+    std::cerr << "Unknown conversion mode: " << convertMode << "\n";
+    return -1;
+  }
+  const bool cpuConvert = convertMode == "cpu";
+  if (offscreenApi != "none" && offscreenApi != "egl" &&
+      offscreenApi != "osmesa") {
+    std::cerr << "Unknown offscreen backend: " << offscreenApi << "\n";
+    return -1;
+  }
+  const bool offscreen = offscreenApi != "none";
+  // Only once the arguments are known to be good: an early exit would not
+  // write the trace
+  if (!tracePath.empty()) {
+    Profiler::startTrace();
+    Profiler::setThreadName("render");
+  }
+
+  // --- Camera matrix and distortion coefficients ---
+  // Loaded for the calibrated resolution here and derived again for the
+  // capture once it is open
+  CalibrationData calib;
+  if (!loadCalibration(calibPath, cv::Size(), calib))
+    return -1;
+
+  if (!poseBenchInput.empty())
+    return runPoseBenchmark(poseBenchInput, calib.calibrated.cameraMatrix,
+                            calib.calibrated.distCoeffs);
+  if (!replayInput.empty()) {
+    int result = runReplayBenchmark(replayInput, replayFrames, queueDepth,
+                                    detectorSettings, calib.calibrated,
+                                    std::cout);
+    if (Profiler::enabled())
+      Profiler::printReport(std::cout);
+    if (!tracePath.empty())
+      Profiler::writeTrace(tracePath);
+    return result;
+  }
+  if (!logToCsv.empty())
+    return convertTelemetryToCsv(logToCsv, "ar_log.csv") ? 0 : -1;
+
   // --- Initialize GLFW ---
+#ifdef GLFW_PLATFORM_NULL
+  // GLFW 3.4+: without a window there is no need for a display connection
+  if (offscreen)
+    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
   if (!glfwInit())
     return -1;
   // // Add windowHints
@@ -115,9 +343,19 @@ int main() {
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
   glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-  GLFWwindow *window =
-      glfwCreateWindow(1280, 720, "AR Window", nullptr, nullptr);
+  if (offscreen) {
+    // The hidden window only carries the context; frames go to an FBO
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API, offscreenApi == "egl"
+                                                  ? GLFW_EGL_CONTEXT_API
+                                                  : GLFW_OSMESA_CONTEXT_API);
+  }
+  const int windowWidth = 1280, windowHeight = 720;
+  GLFWwindow *window = glfwCreateWindow(windowWidth, windowHeight,
+                                        "AR Window", nullptr, nullptr);
   if (!window) {
+    if (offscreen)
+      std::cerr << "Cannot create an " << offscreenApi << " GL context\n";
     glfwTerminate();
     return -1;
   }
@@ -131,6 +369,17 @@ int main() {
 
   glEnable(GL_DEPTH_TEST);
 
+  // Released explicitly before the GL context goes away
+  std::unique_ptr<OffscreenTarget> offscreenTarget;
+  if (offscreen) {
+    offscreenTarget.reset(new OffscreenTarget(windowWidth, windowHeight));
+    if (!offscreenTarget->complete()) {
+      std::cerr << "Offscreen framebuffer is incomplete\n";
+      return -1;
+    }
+    offscreenTarget->bind();
+  }
+
   // --- Setup Dear ImGui context ---
   const char *glsl_version = "#version 330 core";
   IMGUI_CHECKVERSION();
@@ -146,25 +395,34 @@ int main() {
   glm::vec3 guiBaseColor = glm::vec3(0.8f, 0.8f, 0.8f);
 
   // --- OpenCV Capture ---
-  cv::VideoCapture cap(0);
-  if (!cap.isOpened()) {
-    std::cerr << "Cannot open camera\n";
-    return -1;
+  cv::VideoCapture cap;
+  std::unique_ptr<FrameSource> source;
+  int frameWidth, frameHeight;
+  if (!inputPath.empty()) {
+    cv::Size frameSize;
+    source = openReplayInput(inputPath, replayFrames, realtime, frameSize);
+    if (!source)
+      return -1;
+    frameWidth = frameSize.width;
+    frameHeight = frameSize.height;
+  } else {
+    cap.open(cameraIndex);
+    if (!cap.isOpened()) {
+      std::cerr << "Cannot open camera\n";
+      return -1;
+    }
+    frameWidth = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_WIDTH));
+    frameHeight = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_HEIGHT));
   }
-
-  int frameWidth = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_WIDTH));
-  int frameHeight = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_HEIGHT));
+  if (!loadCalibration(calibPath, cv::Size(frameWidth, frameHeight), calib))
+    return -1;
+  const cv::Mat &cameraMatrix = calib.scaled.cameraMatrix;
+  const cv::Mat &distCoeffs = calib.scaled.distCoeffs;
 
   // --- OpenGL Texture ---
-  GLuint textureID;
-  glGenTextures(1, &textureID);
-  glBindTexture(GL_TEXTURE_2D, textureID);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, frameWidth, frameHeight, 0, GL_RGB,
-               GL_UNSIGNED_BYTE, nullptr);
+  // Released explicitly before the GL context goes away
+  std::unique_ptr<TextureStreamer> videoTexture(
+      new TextureStreamer(frameWidth, frameHeight, uploadMode, !cpuConvert));
 
   // --- Quad Vertex Data ---
   float vertices[] = {
@@ -213,13 +471,17 @@ int main() {
       createShaderProgram(screenVertSrc.c_str(), screenFragSrc.c_str());
   glUseProgram(shaderProgram);
   glUniform1i(glGetUniformLocation(shaderProgram, "frameTex"), 0);
+  // Raw frames arrive top row first, and in BGR unless the upload path
+  // already reordered the channels
+  glUniform1i(glGetUniformLocation(shaderProgram, "flipY"), !cpuConvert);
+  glUniform1i(glGetUniformLocation(shaderProgram, "swapRB"),
+              videoTexture->swapsRedBlue());
 
   // --- Logging for measurements ---
-  std::ofstream arLog("ar_log.csv");
-  arLog << "frame,cap_ms,pnp_ms,upload_ms,swap_ms,found,t_x,t_y,t_z,r_x,r_y,r_"
-           "z,reproj_mean,reproj_median,reproj_max\n";
+  // Records go to a writer thread; ar_log.csv is produced from the binary
+  // file once the loop has ended
+  std::unique_ptr<TelemetryWriter> telemetry(new TelemetryWriter(logPath));
   auto startTime = std::chrono::high_resolution_clock::now();
-  int frameIndex = 0;
 
   // --- Cube Vertex Data (duplicate vertices per face, include normals) ---
   // 24 vertices: 6 faces * 4 vertices per face. Each vertex: position (3),
@@ -366,39 +628,157 @@ int main() {
   GLuint unlitProgram =
       createShaderProgram(unlitVertSrc.c_str(), unlitFragSrc.c_str());
 
-  // --- Define camera matrix and distortion coefficients ---
-  cv::Mat cameraMatrix = (cv::Mat_<double>(3, 3) << 2218.397864043568, 0.,
-                          959.5, 0., 2218.397864043568, 539.5, 0., 0., 1.);
-  cv::Mat distCoeffs = (cv::Mat_<double>(5, 1) << -0.17611576780242291,
-                        1.7357972971751359, 0., 0., -5.4837634455342661);
-
-  // --- CALCULATE PROJECTION MATRIX USING CAMERA INTRINSICS ---
-  float nearPlane = 0.01f;
-  float farPlane = 100.0f;
-  float fx = cameraMatrix.at<double>(0, 0);
-  float fy = cameraMatrix.at<double>(1, 1);
-  float cx = cameraMatrix.at<double>(0, 2);
-  float cy = cameraMatrix.at<double>(1, 2);
-
-  glm::mat4 projection = glm::mat4(0.0f);
-  projection[0][0] = 2.0f * fx / frameWidth;
-  projection[1][1] = 2.0f * fy / frameHeight;
-  projection[2][0] = 1.0f - (2.0f * cx) / frameWidth;
-  projection[2][1] = (2.0f * cy) / frameHeight -
-                     1.0f; // Flipped for OpenGL's Y-up coord system
-  projection[2][2] = -(farPlane + nearPlane) / (farPlane - nearPlane);
-  projection[2][3] = -1.0f;
-  projection[3][2] = -2.0f * farPlane * nearPlane / (farPlane - nearPlane);
+  // --- Projection matrix from the camera intrinsics ---
+  // Part of the calibration cache, see loadCalibration
+  glm::mat4 projection = glm::make_mat4(calib.projection);
+
+  // --- Capture / detection pipeline ---
+  // With a budget the controller owns the quality knobs, starting from the
+  // best rung
+  std::unique_ptr<LatencyController> latency;
+  if (budgetMs > 0.0) {
+    latency.reset(new LatencyController(budgetMs, std::cout));
+    LatencyController::apply(latency->level(), detectorSettings);
+  }
+  BoardDetector detector(cv::Size(9, 6), 0.025f, cameraMatrix, distCoeffs);
+  detector.setSettings(detectorSettings);
+  if (!source && captureMode == "latest")
+    source.reset(new LatestFrameCapture(cap));
+  else if (!source)
+    source.reset(new VideoCaptureSource(cap));
+  if (!recordPath.empty()) {
+    RecordingSource *recording =
+        new RecordingSource(std::move(source), recordPath);
+    source.reset(recording);
+    if (!recording->isOpen())
+      return -1;
+  }
+  // The undistorted image keeps the calibrated camera matrix, so the
+  // projection above still fits it; only the lens distortion the cube is
+  // not drawn with goes away
+  UndistortMaps undistortMaps;
+  FramePipeline pipeline(*source, detector, queueDepth, cpuConvert);
+  if (undistortBackground) {
+    undistortMaps.update(cameraMatrix, distCoeffs,
+                         cv::Size(frameWidth, frameHeight), false, -1.0);
+    std::cout << "Undistortion maps built in " << undistortMaps.buildMs()
+              << " ms\n";
+    pipeline.setUndistortion(&undistortMaps);
+  }
+  pipeline.start();
+
+  // Pace the render loop at display rate; it no longer waits for the camera.
+  // Offscreen there is no display to wait for.
+  glfwSwapInterval(offscreen ? 0 : 1);
+  // A recording is rendered frame by frame instead of latest-wins, so every
+  // run draws (and reads back) the same frames
+  const bool inOrder = !inputPath.empty();
+  const bool checkFrames =
+      offscreen && (!readbackDir.empty() || !goldenDir.empty());
+  const double kGoldenMinPsnr = 40.0; // dB
+  cv::Mat rendered;
+  uint64_t goldenChecked = 0, goldenFailed = 0;
+  double goldenWorstPsnr = 0.0;
+  StageStats drawCpuStats, imguiStats, gpuUploadStats, gpuDrawStats;
+
+  // Convert timestamps to milliseconds since start
+  auto to_ms = [&](const std::chrono::high_resolution_clock::time_point &tp) {
+    return std::chrono::duration<double, std::milli>(tp - startTime).count();
+  };
+
+  FramePacket packet; // frame and pose currently on screen
+  bool hasFrame = false;
+  double renderMs = 0.0;
+  uint64_t droppedTotal = 0;
+
+  // Heap allocations of the render thread per loop iteration. They stop once
+  // the pipeline's packet pool is warm; frames shown before that are not held
+  // against the loop.
+  const uint64_t allocWarmupFrames =
+      allocCheckAfter > 0 ? allocCheckAfter : 120;
+  uint64_t framesShown = 0;
+  uint64_t renderAllocs = 0;
+  uint64_t steadyAllocs = 0; // allocations after warm-up
+  uint64_t allocMark = threadAllocationCount();
+  int exitCode = 0;
+
+  // GPU timings arrive a few frames late; each rendered frame's record
+  // waits in the slot of the same index until they do. The timer is
+  // released explicitly before the GL context goes away.
+  std::unique_ptr<GpuTimer> gpuTimer(new GpuTimer());
+  TelemetryRecord logRows[GpuTimer::kFramesInFlight];
+  bool logPending[GpuTimer::kFramesInFlight] = {};
+  GpuFrameTimes gpuTimes, lastGpuTimes;
+  uint64_t renderFrame = 0;
+
+  auto writeRow = [&](const GpuFrameTimes &gpu) {
+    const size_t slot = gpu.frame % GpuTimer::kFramesInFlight;
+    if (!logPending[slot])
+      return;
+    logPending[slot] = false;
+    TelemetryRecord &row = logRows[slot];
+    row.uploadMs = to_ms(gpu.tUploaded);
+    row.gpuUploadMs = gpu.uploadMs;
+    row.gpuDrawMs = gpu.drawMs;
+    row.gpuDoneMs = to_ms(gpu.tDone);
+    telemetry->push(row);
+  };
 
   // --- Main Loop ---
   while (!glfwWindowShouldClose(window)) {
-    cv::Mat frame;
-    cap >> frame;
-    auto t_capture = std::chrono::high_resolution_clock::now();
-    if (frame.empty())
+    // Allocations of the previous iteration, which may have ended early
+    const uint64_t allocNow = threadAllocationCount();
+    renderAllocs = allocNow - allocMark;
+    allocMark = allocNow;
+    if (framesShown > allocWarmupFrames) {
+      steadyAllocs += renderAllocs;
+      if (allocCheckAfter > 0 && renderAllocs > 0) {
+        std::cerr << "Render loop allocated " << renderAllocs
+                  << " times after " << framesShown << " frames\n";
+        exitCode = 1;
+        break;
+      }
+    }
+
+    // Log every frame the GPU has finished by now; only block when all
+    // timer slots are still in flight
+    PROFILE_TIMER(gpuPollTimer, "render/gpu_poll");
+    while (gpuTimer->poll(gpuTimes, gpuTimer->full())) {
+      writeRow(gpuTimes);
+      lastGpuTimes = gpuTimes;
+      gpuUploadStats.record(gpuTimes.uploadMs);
+      gpuDrawStats.record(gpuTimes.drawMs);
+    }
+    gpuPollTimer.stop();
+
+    auto t_render = std::chrono::high_resolution_clock::now();
+    PROFILE_TIMER(popTimer, "render/pop");
+    bool newFrame =
+        inOrder ? pipeline.tryPop(packet) : pipeline.tryPopLatest(packet);
+    popTimer.stop();
+    if (!newFrame && pipeline.finished())
       break;
+    if (inOrder && !newFrame) {
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+      continue;
+    }
+    hasFrame = hasFrame || newFrame;
+    if (newFrame) {
+      Profiler::setFrame(packet.index);
+      droppedTotal += packet.dropped;
+      ++framesShown;
+      if (latency) {
+        DetectorSettings tuned = detector.settings();
+        if (latency->update(packet.index, packet.detection, tuned))
+          detector.setSettings(tuned);
+      }
+    }
+    const BoardDetection &detection = packet.detection;
+    bool found = hasFrame && detection.found;
 
     // Start the Dear ImGui frame
+    double imguiBuildMs = 0.0, imguiRenderMs = 0.0, drawCpuMs = 0.0;
+    PROFILE_TIMER_MS(imguiBuildTimer, "render/imgui_build", &imguiBuildMs);
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
@@ -423,118 +803,167 @@ int main() {
     }
     ImGui::End();
 
-    // 1. Create a grayscale copy of the ORIGINAL frame for detection
-    cv::Mat gray;
-    cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
-
-    // 2. Find checkerboard corners in the original, un-flipped image
-    std::vector<cv::Point2f> corners;
-    bool found = cv::findChessboardCorners(gray, cv::Size(9, 6), corners,
-                                           cv::CALIB_CB_ADAPTIVE_THRESH |
-                                               cv::CALIB_CB_NORMALIZE_IMAGE |
-                                               cv::CALIB_CB_FAST_CHECK);
-
-    // 3. Convert the color frame to RGB for drawing
-    cv::cvtColor(frame, frame, cv::COLOR_BGR2RGB);
-
-    cv::Mat rvec, tvec; // Declare here to be in scope for cube rendering
-    // Per-frame measurement values (defaults for missing data)
-    double reproj_mean = -1.0, reproj_median = -1.0, reproj_max = -1.0;
-    auto t_pnp = t_capture;
-
-    if (found) {
-      cv::cornerSubPix(
-          gray, corners, cv::Size(11, 11), cv::Size(-1, -1),
-          cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 30,
-                           0.1));
-
-      std::vector<cv::Point3f> objectPoints;
-      for (int i = 0; i < 6; ++i) {
-        for (int j = 0; j < 9; ++j) {
-          objectPoints.push_back(cv::Point3f(j * 0.025f, i * 0.025f, 0));
-        }
+    // GUI: per-stage timing and queue depth in the upper-right corner
+    ImGui::SetNextWindowBgAlpha(0.35f);
+    ImGui::SetNextWindowPos(ImVec2(io.DisplaySize.x - 10.0f, 10.0f),
+                            ImGuiCond_Always, ImVec2(1.0f, 0.0f));
+    ImGui::Begin("Pipeline", nullptr, window_flags);
+    {
+      const StageStats &capStats = pipeline.captureStats();
+      const StageStats &detStats = pipeline.detectStats();
+      ImGui::Text("capture %6.2f ms (avg %6.2f)  queue %zu/%zu  stalls %llu",
+                  capStats.lastMs.load(), capStats.avgMs.load(),
+                  pipeline.captureQueueDepth(), pipeline.queueCapacity(),
+                  (unsigned long long)capStats.stalls.load());
+      ImGui::Text("detect  %6.2f ms (avg %6.2f)  queue %zu/%zu  stalls %llu",
+                  detStats.lastMs.load(), detStats.avgMs.load(),
+                  pipeline.resultQueueDepth(), pipeline.queueCapacity(),
+                  (unsigned long long)detStats.stalls.load());
+      ImGui::Text("render  %6.2f ms  skipped frames %llu", renderMs,
+                  (unsigned long long)pipeline.skippedFrames());
+      ImGui::Text("gpu     upload %5.2f ms  draw %5.2f ms  waits %llu",
+                  lastGpuTimes.uploadMs, lastGpuTimes.drawMs,
+                  (unsigned long long)gpuTimer->stalls());
+      ImGui::Text("log     queued %zu  written %llu  dropped %llu",
+                  telemetry->queued(),
+                  (unsigned long long)telemetry->written(),
+                  (unsigned long long)telemetry->dropped());
+      const TextureStreamer::Stats &uploadStats = videoTexture->stats();
+      ImGui::Text("upload  %s%s  cpu %5.2f ms  in flight %d/%d  waits %llu",
+                  uploadModeName(videoTexture->mode()),
+                  videoTexture->persistent() ? " (persistent)" : "",
+                  uploadStats.writeMs, uploadStats.inFlight,
+                  TextureStreamer::kRingSize,
+                  (unsigned long long)uploadStats.waits);
+      const StageStats &convStats = pipeline.convertStats();
+      if (cpuConvert)
+        ImGui::Text("convert cpu  %5.2f ms (avg %5.2f)",
+                    convStats.lastMs.load(), convStats.avgMs.load());
+      else
+        ImGui::Text("convert shader  saves ~%5.2f ms/frame on the CPU",
+                    convStats.avgMs.load());
+      if (undistortBackground)
+        ImGui::Text("undistort remap  %5.2f ms (avg %5.2f)",
+                    pipeline.undistortStats().lastMs.load(),
+                    pipeline.undistortStats().avgMs.load());
+      ImGui::Text("capture mode %s  dropped frames %llu", captureMode.c_str(),
+                  (unsigned long long)droppedTotal);
+      ImGui::Text("allocs/frame  capture %llu  detect %llu  render %llu",
+                  (unsigned long long)capStats.allocations.load(),
+                  (unsigned long long)detStats.allocations.load(),
+                  (unsigned long long)renderAllocs);
+
+      ImGui::Separator();
+      DetectorSettings settings = detector.settings();
+      bool changed = ImGui::Checkbox("ROI search", &settings.roiSearch);
+      changed |=
+          ImGui::SliderFloat("ROI margin", &settings.roiMargin, 0.05f, 1.0f);
+      changed |= ImGui::SliderInt("Pyramid level (-1 auto)",
+                                  &settings.pyramidLevel, -1,
+                                  kMaxPyramidLevel);
+      changed |= ImGui::Checkbox("KLT tracking", &settings.tracking);
+      changed |= ImGui::SliderInt("Redetect every", &settings.redetectInterval,
+                                  1, 60);
+      changed |= ImGui::Checkbox("Motion gate", &settings.motionGate);
+      changed |= ImGui::SliderFloat("Motion threshold",
+                                    &settings.motionThreshold, 0.5f, 10.0f);
+      changed |=
+          ImGui::SliderInt("Idle search every", &settings.idleInterval, 1, 60);
+      const char *poseMethods[kPoseMethodCount];
+      for (int m = 0; m < kPoseMethodCount; ++m)
+        poseMethods[m] = poseMethodName(static_cast<PoseMethod>(m));
+      int poseMethod = static_cast<int>(settings.poseMethod);
+      if (ImGui::Combo("Pose solver", &poseMethod, poseMethods,
+                       kPoseMethodCount)) {
+        settings.poseMethod = static_cast<PoseMethod>(poseMethod);
+        changed = true;
       }
-
-      // 4. Get correct pose data from the un-flipped corners
-      cv::solvePnP(objectPoints, corners, cameraMatrix, distCoeffs, rvec, tvec);
-
-      // timestamp after pose estimation
-      t_pnp = std::chrono::high_resolution_clock::now();
-
-      // Compute reprojection error (pixels) between projected object points and
-      // detected corners
-      std::vector<cv::Point2f> projPoints;
-      cv::projectPoints(objectPoints, rvec, tvec, cameraMatrix, distCoeffs,
-                        projPoints);
-      std::vector<double> reprojErrors;
-      reprojErrors.reserve(projPoints.size());
-      for (size_t i = 0; i < projPoints.size(); ++i) {
-        double dx = projPoints[i].x - corners[i].x;
-        double dy = projPoints[i].y - corners[i].y;
-        reprojErrors.push_back(std::sqrt(dx * dx + dy * dy));
+      changed |= ImGui::Checkbox("Warm start", &settings.poseWarmStart);
+      if (changed)
+        detector.setSettings(settings);
+      const DetectorStats &detectorStats = detector.stats();
+      ImGui::Text("full search %6.2f ms avg  hits %llu  misses %llu",
+                  detectorStats.fullSearch.avgMs.load(),
+                  (unsigned long long)detectorStats.fullHits.load(),
+                  (unsigned long long)detectorStats.fullMisses.load());
+      ImGui::Text("roi search  %6.2f ms avg  hits %llu  misses %llu",
+                  detectorStats.roiSearch.avgMs.load(),
+                  (unsigned long long)detectorStats.roiHits.load(),
+                  (unsigned long long)detectorStats.roiMisses.load());
+      ImGui::Text("tracking    %6.2f ms avg  hits %llu  losses %llu",
+                  detectorStats.tracking.avgMs.load(),
+                  (unsigned long long)detectorStats.trackHits.load(),
+                  (unsigned long long)detectorStats.trackLosses.load());
+      if (latency) {
+        float budget = static_cast<float>(latency->budgetMs());
+        if (ImGui::SliderFloat("Detection budget ms", &budget, 2.0f, 100.0f))
+          latency->setBudgetMs(budget);
+        ImGui::Text("quality %s (%d/%d)  detection %6.2f ms avg  changes %llu",
+                    latency->quality().name, latency->level(),
+                    LatencyController::levelCount() - 1, latency->averageMs(),
+                    (unsigned long long)latency->changes());
       }
-      if (!reprojErrors.empty()) {
-        reproj_mean =
-            std::accumulate(reprojErrors.begin(), reprojErrors.end(), 0.0) /
-            reprojErrors.size();
-        std::vector<double> tmp = reprojErrors;
-        size_t mid = tmp.size() / 2;
-        std::nth_element(tmp.begin(), tmp.begin() + mid, tmp.end());
-        reproj_median = tmp[mid];
-        reproj_max =
-            *std::max_element(reprojErrors.begin(), reprojErrors.end());
+      ImGui::Text("gate skips  static %llu  idle %llu  saved %.0f ms",
+                  (unsigned long long)detectorStats.staticSkips.load(),
+                  (unsigned long long)detectorStats.idleSkips.load(),
+                  detectorStats.savedMs.load());
+      ImGui::Text("pose (%s) %6.3f ms avg",
+                  poseMethodName(settings.poseMethod),
+                  detectorStats.pose.avgMs.load());
+      for (int level = 0; level <= kMaxPyramidLevel; ++level) {
+        const DetectorStats::Level &levelStats = detectorStats.levels[level];
+        const uint64_t hits = levelStats.hits;
+        ImGui::Text("level %d (1/%d) %6.2f ms avg  found %llu  reproj %.3f px",
+                    level, 1 << level, levelStats.search.avgMs.load(),
+                    (unsigned long long)hits,
+                    hits ? levelStats.reprojMeanSum / hits : 0.0);
       }
-
-      // Draw axes for visualization on the un-flipped color frame
-      // std::vector<cv::Point3f> axisPoints;
-      // axisPoints.push_back(cv::Point3f(0, 0, 0));
-      // axisPoints.push_back(cv::Point3f(0.075f, 0, 0));
-      // axisPoints.push_back(cv::Point3f(0, 0.075f, 0));
-      // axisPoints.push_back(cv::Point3f(0, 0, -0.075f));
-      // std::vector<cv::Point2f> imagePoints;
-      // cv::projectPoints(axisPoints, rvec, tvec, cameraMatrix, distCoeffs,
-      //                   imagePoints);
-      // cv::line(frame, imagePoints[0], imagePoints[1], cv::Scalar(255, 0, 0),
-      // 5); cv::line(frame, imagePoints[0], imagePoints[2], cv::Scalar(0, 255,
-      // 0), 5); cv::line(frame, imagePoints[0], imagePoints[3], cv::Scalar(0,
-      // 0, 255), 5);
     }
-
-    // 5. Flip the final frame (with or without axes) vertically for OpenGL
-    cv::flip(frame, frame, 0);
+    ImGui::End();
+    imguiBuildTimer.stop();
 
     // --- RENDER EVERYTHING ---
 
-    // Upload the prepared frame to the OpenGL texture
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, frame.cols, frame.rows, GL_RGB,
-                    GL_UNSIGNED_BYTE, frame.data);
-    glFinish();
-    auto t_upload = std::chrono::high_resolution_clock::now();
+    // Upload the prepared frame to the OpenGL texture (only when the
+    // detection stage delivered a new one). Either path is done with the
+    // frame's pixels when upload() returns, so the packet may be recycled
+    // even though the GPU has not necessarily consumed them yet.
+    gpuTimer->beginFrame(renderFrame);
+    if (newFrame) {
+      PROFILE_SCOPE("render/upload");
+      videoTexture->upload(packet.frame);
+    }
+    gpuTimer->markUpload();
 
     // Clear buffers and render the video background (happens every frame)
+    PROFILE_TIMER_MS(drawTimer, "render/draw", &drawCpuMs);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glDepthMask(GL_FALSE); // Disable depth writing for background
-    glUseProgram(shaderProgram);
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    if (hasFrame) {
+      glDepthMask(GL_FALSE); // Disable depth writing for background
+      glUseProgram(shaderProgram);
+      glBindTexture(GL_TEXTURE_2D, videoTexture->texture());
+      glBindVertexArray(VAO);
+      glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    }
 
     glDepthMask(GL_TRUE); // Re-enable depth writing for 3D objects
 
     // If found, render the cube on top
     if (found) {
+      const cv::Mat &rvec = detection.rvec;
+      const cv::Mat &tvec = detection.tvec;
       glUseProgram(cubeShaderProgram);
 
       glm::mat4 view = glm::mat4(1.0f);
 
-      cv::Mat R;
-      cv::Rodrigues(rvec, R);
+      // Axis-angle to rotation matrix in glm (same as cv::Rodrigues), so no
+      // cv::Mat is created on the render thread
+      glm::vec3 axis(rvec.at<double>(0, 0), rvec.at<double>(1, 0),
+                     rvec.at<double>(2, 0));
+      float angle = glm::length(axis);
       glm::mat4 model = glm::mat4(1.0f);
-      for (int i = 0; i < 3; ++i) {
-        for (int j = 0; j < 3; ++j) {
-          model[i][j] = R.at<double>(j, i);
-        }
-      }
+      if (angle > 0.0f)
+        model = glm::rotate(model, angle, axis / angle);
       model[3][0] = tvec.at<double>(0, 0);
       model[3][1] = tvec.at<double>(1, 0);
       model[3][2] = tvec.at<double>(2, 0);
@@ -574,7 +1003,7 @@ int main() {
       // Transform the GUI light direction into camera space using the
       // final model's linear part so it is expressed in the same space as
       // the transformed normals. This uses the full `model` (including
-      // axisCorrection/scale) rather than the raw Rodrigues rotation `R`.
+      // axisCorrection/scale) rather than the raw Rodrigues rotation.
       glm::vec3 lightDirCam = glm::normalize(glm::mat3(model) * guiLightDir);
       glUniform3fv(glGetUniformLocation(cubeShaderProgram, "lightDir"), 1,
                    glm::value_ptr(lightDirCam));
@@ -619,49 +1048,129 @@ int main() {
       glDrawElements(GL_TRIANGLES, sphereIndexCount, GL_UNSIGNED_INT, 0);
     }
 
+    drawTimer.stop();
+    drawCpuStats.record(drawCpuMs);
+
+    // Golden images hold the scene only: the GUI shows live timings
+    if (checkFrames && newFrame && packet.index % readbackEvery == 0) {
+      PROFILE_SCOPE("render/readback");
+      offscreenTarget->read(rendered);
+      const std::string name = cv::format("frame_%05llu.png",
+                                          (unsigned long long)packet.index);
+      if (!readbackDir.empty())
+        cv::imwrite(readbackDir + "/" + name, rendered);
+      if (!goldenDir.empty()) {
+        const double psnr = goldenPsnr(rendered, goldenDir + "/" + name);
+        if (goldenChecked == 0 || psnr < goldenWorstPsnr)
+          goldenWorstPsnr = psnr;
+        ++goldenChecked;
+        if (psnr < kGoldenMinPsnr) {
+          ++goldenFailed;
+          std::cerr << name << " differs from the golden image (PSNR "
+                    << psnr << " dB)\n";
+        }
+      }
+    }
+
     // Render ImGui on top
+    PROFILE_TIMER_MS(imguiRenderTimer, "render/imgui_render", &imguiRenderMs);
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-
-    // Ensure all GL work is finished, then swap buffers and timestamp
-    glFinish();
-    glfwSwapBuffers(window);
+    imguiRenderTimer.stop();
+    imguiStats.record(imguiBuildMs + imguiRenderMs);
+
+    // No glFinish: the GPU timer reports when the frame actually completed
+    gpuTimer->endFrame();
+    if (!offscreen) {
+      PROFILE_SCOPE("render/swap");
+      glfwSwapBuffers(window);
+    }
     auto t_swap = std::chrono::high_resolution_clock::now();
+    const uint64_t frameSlot = renderFrame++ % GpuTimer::kFramesInFlight;
+    PROFILE_TIMER(eventsTimer, "render/poll_events");
     glfwPollEvents();
-
-    // Convert timestamps to milliseconds since start
-    auto to_ms = [&](const std::chrono::high_resolution_clock::time_point &tp) {
-      return std::chrono::duration<double, std::milli>(tp - startTime).count();
-    };
-
-    double cap_ms = to_ms(t_capture);
-    double pnp_ms = to_ms(t_pnp);
-    double upload_ms = to_ms(t_upload);
-    double swap_ms = to_ms(t_swap);
-
-    // Extract tvec/rvec values (or zeros if not found)
-    double tx = 0, ty = 0, tz = 0, rx = 0, ry = 0, rz = 0;
-    if (!tvec.empty()) {
-      tx = tvec.at<double>(0, 0);
-      ty = tvec.at<double>(1, 0);
-      tz = tvec.at<double>(2, 0);
-    }
-    if (!rvec.empty()) {
-      rx = rvec.at<double>(0, 0);
-      ry = rvec.at<double>(1, 0);
-      rz = rvec.at<double>(2, 0);
+    eventsTimer.stop();
+    renderMs =
+        std::chrono::duration<double, std::milli>(t_swap - t_render).count();
+
+    // Only frames that made it to the screen get a log row
+    if (!newFrame)
+      continue;
+
+    // Everything but the GPU columns is known now; upload_ms becomes the
+    // GPU's upload completion once the timer results are in
+    logPending[frameSlot] = true;
+    TelemetryRecord &row = logRows[frameSlot];
+    row.frame = packet.index;
+    row.capMs = to_ms(packet.tCapture);
+    row.pnpMs = to_ms(packet.tPnp);
+    row.swapMs = to_ms(t_swap);
+    row.found = found;
+    for (int i = 0; i < 3; ++i) {
+      // Extract tvec/rvec values (or zeros if not found)
+      row.t[i] = found ? detection.tvec.at<double>(i, 0) : 0.0;
+      row.r[i] = found ? detection.rvec.at<double>(i, 0) : 0.0;
     }
+    row.reprojMean = detection.reprojMean;
+    row.reprojMedian = detection.reprojMedian;
+    row.reprojMax = detection.reprojMax;
+    row.captureQueue = static_cast<uint32_t>(pipeline.captureQueueDepth());
+    row.resultQueue = static_cast<uint32_t>(pipeline.resultQueueDepth());
+    row.dropped = packet.dropped;
+    row.detectMode = static_cast<uint8_t>(detection.mode);
+    row.detectMs = detection.detectMs;
+    row.pyramidLevel = static_cast<int8_t>(detection.pyramidLevel);
+    row.qualityLevel = static_cast<int8_t>(latency ? latency->level() : -1);
+    row.poseMs = detection.poseMs;
+    row.uploadCpuMs = videoTexture->stats().writeMs;
+    row.pboInFlight = videoTexture->stats().inFlight;
+    // What the shader path saves is estimated from the sampled conversions
+    row.convertMs = packet.convertMs;
+    row.convertSavedMs =
+        cpuConvert ? 0.0 : pipeline.convertStats().avgMs.load();
+    row.grayMs = detection.grayMs;
+    row.subPixMs = detection.subPixMs;
+    row.reprojMs = detection.reprojMs;
+    row.imguiMs = imguiBuildMs + imguiRenderMs;
+    row.drawCpuMs = drawCpuMs;
+  }
 
-    // Write CSV row
-    arLog << frameIndex << "," << std::fixed << std::setprecision(3) << cap_ms
-          << "," << pnp_ms << "," << upload_ms << "," << swap_ms << ","
-          << (found ? 1 : 0) << "," << tx << "," << ty << "," << tz << "," << rx
-          << "," << ry << "," << rz << "," << reproj_mean << ","
-          << reproj_median << "," << reproj_max << "\n";
-    arLog.flush();
-    ++frameIndex;
+  // Log the frames still in flight
+  while (gpuTimer->poll(gpuTimes, true))
+    writeRow(gpuTimes);
+  const uint64_t logDropped = telemetry->dropped();
+  telemetry.reset(); // drains the ring and closes the file
+  if (logDropped)
+    std::cerr << "Telemetry ring overflowed, " << logDropped
+              << " records lost\n";
+  convertTelemetryToCsv(logPath, "ar_log.csv");
+
+  pipeline.stop();
+  detector.printReport(std::cout);
+  if (Profiler::enabled())
+    Profiler::printReport(std::cout);
+  if (!tracePath.empty())
+    Profiler::writeTrace(tracePath);
+  std::cout << "Render loop allocations after " << allocWarmupFrames
+            << " warm-up frames: " << steadyAllocs << "\n";
+  std::cout << "Rendered " << renderFrame << " frames"
+            << (offscreen ? " offscreen (" + offscreenApi + ")" : "")
+            << ": draw cpu " << drawCpuStats.avgMs << " ms avg, gui "
+            << imguiStats.avgMs << " ms avg, gpu upload "
+            << gpuUploadStats.avgMs << " ms avg, gpu draw "
+            << gpuDrawStats.avgMs << " ms avg\n";
+  if (!goldenDir.empty()) {
+    std::cout << "Golden images: " << goldenChecked << " compared, "
+              << goldenFailed << " below " << kGoldenMinPsnr
+              << " dB, worst " << goldenWorstPsnr << " dB\n";
+    if (goldenFailed > 0 || goldenChecked == 0)
+      exitCode = 1;
   }
 
+  gpuTimer.reset();
+  videoTexture.reset();
+  offscreenTarget.reset();
+
   // Cleanup ImGui
   ImGui_ImplOpenGL3_Shutdown();
   ImGui_ImplGlfw_Shutdown();
@@ -683,5 +1192,5 @@ int main() {
   glDeleteBuffers(1, &sphereEBO);
 
   glfwTerminate();
-  return 0;
+  return exitCode;
 }
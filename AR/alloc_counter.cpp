@@ -0,0 +1,53 @@
+#include "alloc_counter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+std::atomic<uint64_t> totalAllocations{0};
+// Plain integral thread_local: no constructor, so it is safe to touch from
+// operator new even while a thread is starting up or shutting down
+thread_local uint64_t threadAllocations = 0;
+
+void *countedAlloc(std::size_t size) {
+  totalAllocations.fetch_add(1, std::memory_order_relaxed);
+  ++threadAllocations;
+  return std::malloc(size ? size : 1);
+}
+} // namespace
+
+uint64_t allocationCount() {
+  return totalAllocations.load(std::memory_order_relaxed);
+}
+
+uint64_t threadAllocationCount() { return threadAllocations; }
+
+void *operator new(std::size_t size) {
+  if (void *p = countedAlloc(size))
+    return p;
+  throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) {
+  if (void *p = countedAlloc(size))
+    return p;
+  throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return countedAlloc(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return countedAlloc(size);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { std::free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+  std::free(p);
+}
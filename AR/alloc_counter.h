@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+// Heap allocation counters fed by the global operator new replacement in
+// alloc_counter.cpp. Only allocations that go through operator new are
+// seen: OpenCV pixel buffers (fastMalloc) and malloc-based libraries such as
+// ImGui or GLFW are not, but every cv::Mat allocation also news its
+// UMatData, so a Mat that gets (re)allocated still shows up.
+
+// Allocations made by any thread since program start.
+uint64_t allocationCount();
+// Allocations made by the calling thread since it started.
+uint64_t threadAllocationCount();
@@ -0,0 +1,453 @@
+#include "board_detector.h"
+
+#include "common/profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace {
+std::vector<cv::Point3f> boardObjectPoints(cv::Size boardSize,
+                                           float squareSize) {
+  std::vector<cv::Point3f> objectPoints;
+  for (int i = 0; i < boardSize.height; ++i) {
+    for (int j = 0; j < boardSize.width; ++j) {
+      objectPoints.push_back(cv::Point3f(j * squareSize, i * squareSize, 0));
+    }
+  }
+  return objectPoints;
+}
+
+double elapsedMs(std::chrono::high_resolution_clock::time_point from) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::high_resolution_clock::now() - from)
+      .count();
+}
+
+double rate(uint64_t hits, uint64_t misses) {
+  return hits + misses ? 100.0 * hits / (hits + misses) : 0.0;
+}
+} // namespace
+
+BoardDetector::BoardDetector(cv::Size boardSize, float squareSize,
+                             const cv::Mat &cameraMatrix,
+                             const cv::Mat &distCoeffs)
+    : boardSize_(boardSize),
+      objectPoints_(boardObjectPoints(boardSize, squareSize)),
+      cameraMatrix_(cameraMatrix.clone()), distCoeffs_(distCoeffs.clone()),
+      pose_(objectPoints_, cameraMatrix_, distCoeffs_) {
+  projPoints_.reserve(objectPoints_.size());
+  reprojErrors_.reserve(objectPoints_.size());
+}
+
+const char *detectModeName(DetectMode mode) {
+  switch (mode) {
+  case DetectMode::Full:
+    return "full";
+  case DetectMode::Roi:
+    return "roi";
+  case DetectMode::Track:
+    return "track";
+  case DetectMode::Static:
+    return "static";
+  default:
+    return "none";
+  }
+}
+
+DetectorSettings BoardDetector::settings() const {
+  std::lock_guard<std::mutex> lock(settingsMutex_);
+  return settings_;
+}
+
+void BoardDetector::setSettings(const DetectorSettings &settings) {
+  std::lock_guard<std::mutex> lock(settingsMutex_);
+  settings_ = settings;
+}
+
+bool BoardDetector::detect(const cv::Mat &frame, BoardDetection &out) {
+  PROFILE_SCOPE("detect/board");
+  const DetectorSettings settings = this->settings();
+  auto t_start = std::chrono::high_resolution_clock::now();
+  out.found = false;
+  out.mode = DetectMode::None;
+  out.gated = false;
+  out.pyramidLevel = -1;
+  out.reprojMean = out.reprojMedian = out.reprojMax = -1.0;
+  out.grayMs = out.subPixMs = out.reprojMs = out.poseMs = 0.0;
+
+  if (settings.motionGate && skipUnchanged(frame, settings, out)) {
+    out.gated = true;
+    out.detectMs = elapsedMs(t_start);
+    stats_.gate.record(out.detectMs);
+    // A skipped frame costs the gate instead of a whole run
+    const double saved = stats_.run.avgMs - out.detectMs;
+    if (saved > 0.0)
+      stats_.savedMs = stats_.savedMs + saved;
+    return out.found;
+  }
+  const bool found = detectChanged(frame, settings, out);
+  stats_.run.record(elapsedMs(t_start));
+  return found;
+}
+
+// Downscales the frame, compares it with the last frame detection ran on
+// and fills `out` without detecting if nothing relevant changed. The
+// comparison is against that reference rather than the previous frame, so
+// slow drift still adds up to a re-detection. cv::resize with INTER_AREA
+// and cv::norm are both vectorized, so this costs a fraction of a
+// millisecond even at 1080p.
+bool BoardDetector::skipUnchanged(const cv::Mat &frame,
+                                  const DetectorSettings &settings,
+                                  BoardDetection &out) {
+  PROFILE_SCOPE("detect/motion_gate");
+  const int factor = 8;
+  cv::resize(frame, motionColor_, cv::Size(), 1.0 / factor, 1.0 / factor,
+             cv::INTER_AREA);
+  cv::cvtColor(motionColor_, motionSmall_, cv::COLOR_BGR2GRAY);
+
+  bool skip = false;
+  if (motionRef_.size() == motionSmall_.size()) {
+    const cv::Rect all(0, 0, motionSmall_.cols, motionSmall_.rows);
+    cv::Rect region = all;
+    if (hasPrevious_) {
+      const cv::Rect box = predictRoi(frame.size(), settings.roiMargin);
+      region = cv::Rect(box.x / factor, box.y / factor,
+                        (box.width + factor - 1) / factor,
+                        (box.height + factor - 1) / factor) &
+               all;
+    }
+    double meanDiff = 256.0;
+    if (region.area() > 0)
+      meanDiff = cv::norm(motionSmall_(region), motionRef_(region),
+                          cv::NORM_L1) /
+                 region.area();
+    const bool still = meanDiff < settings.motionThreshold;
+
+    if (hasPrevious_ && still) {
+      out.found = true;
+      out.mode = DetectMode::Static;
+      out.corners = prevCorners_;
+      prevRvec_.copyTo(out.rvec);
+      prevTvec_.copyTo(out.tvec);
+      out.reprojMean = prevReprojMean_;
+      out.reprojMedian = prevReprojMedian_;
+      out.reprojMax = prevReprojMax_;
+      out.tPose = std::chrono::high_resolution_clock::now();
+      ++stats_.staticSkips;
+      skip = true;
+    } else if (!hasPrevious_ && still &&
+               ++idleSkipped_ < settings.idleInterval) {
+      // Nothing in view and nothing moved: look again later
+      ++stats_.idleSkips;
+      skip = true;
+    }
+  }
+  if (!skip) {
+    idleSkipped_ = 0;
+    std::swap(motionRef_, motionSmall_);
+  }
+  return skip;
+}
+
+bool BoardDetector::detectChanged(const cv::Mat &frame,
+                                  const DetectorSettings &settings,
+                                  BoardDetection &out) {
+  auto t_start = std::chrono::high_resolution_clock::now();
+
+  // 1. Create a grayscale copy of the ORIGINAL frame for detection, keeping
+  // the previous one around for optical flow
+  std::swap(gray_, prevGray_);
+  {
+    PROFILE_SCOPE_MS("detect/gray", &out.grayMs);
+    cv::cvtColor(frame, gray_, cv::COLOR_BGR2GRAY);
+  }
+
+  // 2. Between full detections, follow the previous corners with KLT and
+  // accept them only if the resulting pose explains them well
+  if (settings.tracking && hasPrevious_ &&
+      framesSinceDetect_ < settings.redetectInterval &&
+      prevGray_.size() == gray_.size()) {
+    auto t_track = std::chrono::high_resolution_clock::now();
+    bool tracked = trackCorners(settings, out.corners);
+    out.detectMs = elapsedMs(t_start);
+    if (tracked) {
+      estimatePose(settings, out);
+      tracked = out.reprojMax <= settings.maxTrackReprojError;
+    }
+    stats_.tracking.record(elapsedMs(t_track));
+    if (tracked) {
+      out.found = true;
+      out.mode = DetectMode::Track;
+      ++stats_.trackHits;
+      ++framesSinceDetect_;
+      updateHistory(out);
+      return true;
+    }
+    ++stats_.trackLosses;
+    // The pose of a rejected track must not seed the re-detection below
+    pose_.restore(prevRvec_, prevTvec_);
+    out.rvec.release();
+    out.tvec.release();
+    out.poseMs = 0.0;
+    out.reprojMean = out.reprojMedian = out.reprojMax = -1.0;
+  }
+
+  const int level = choosePyramidLevel(settings);
+
+  // 3a. Look where the board was last frame first
+  if (settings.roiSearch && hasPrevious_) {
+    cv::Rect roi = predictRoi(gray_.size(), settings.roiMargin);
+    // Not worth it when the board already fills most of the image
+    if (roi.area() < 0.8 * gray_.rows * gray_.cols) {
+      auto t_roi = std::chrono::high_resolution_clock::now();
+      bool hit =
+          findCorners(roi, level, settings.chessboardFlags, out.corners);
+      stats_.roiSearch.record(elapsedMs(t_roi));
+      if (hit) {
+        out.pyramidLevel = level;
+        out.found = true;
+        out.mode = DetectMode::Roi;
+        ++stats_.roiHits;
+      } else {
+        ++stats_.roiMisses;
+      }
+    }
+  }
+
+  // 3b. Find checkerboard corners in the original, un-flipped image
+  if (!out.found) {
+    const cv::Rect all(0, 0, gray_.cols, gray_.rows);
+    auto t_full = std::chrono::high_resolution_clock::now();
+    out.found =
+        findCorners(all, level, settings.chessboardFlags, out.corners);
+    out.pyramidLevel = level;
+    // A board too small for the coarse image may still be found at full
+    // resolution
+    if (!out.found && level > 0) {
+      out.found = findCorners(all, 0, settings.chessboardFlags, out.corners);
+      out.pyramidLevel = 0;
+    }
+    stats_.fullSearch.record(elapsedMs(t_full));
+    if (out.found) {
+      out.mode = DetectMode::Full;
+      ++stats_.fullHits;
+    } else {
+      ++stats_.fullMisses;
+    }
+  }
+
+  if (!out.found) {
+    hasPrevious_ = false;
+    pose_.reset();
+    out.pyramidLevel = -1;
+    out.detectMs = elapsedMs(t_start);
+    return false;
+  }
+
+  // Corners from a coarse level are only a few full-resolution pixels off,
+  // well inside the refinement window
+  {
+    PROFILE_SCOPE_MS("detect/subpix", &out.subPixMs);
+    cv::cornerSubPix(
+        gray_, out.corners,
+        cv::Size(settings.subPixWindow, settings.subPixWindow),
+        cv::Size(-1, -1),
+        cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT,
+                         settings.subPixIterations, 0.1));
+  }
+  out.detectMs = elapsedMs(t_start);
+
+  // 4. Get pose data from the un-flipped corners
+  estimatePose(settings, out);
+  framesSinceDetect_ = 0;
+  DetectorStats::Level &levelStats = stats_.levels[out.pyramidLevel];
+  ++levelStats.hits;
+  levelStats.reprojMeanSum = levelStats.reprojMeanSum + out.reprojMean;
+  updateHistory(out);
+  return true;
+}
+
+void BoardDetector::estimatePose(const DetectorSettings &settings,
+                                 BoardDetection &out) {
+  {
+    PROFILE_SCOPE_MS("detect/pose", &out.poseMs);
+    pose_.estimate(out.corners, settings.poseMethod, settings.poseWarmStart,
+                   out.rvec, out.tvec);
+  }
+  out.tPose = std::chrono::high_resolution_clock::now();
+  stats_.pose.record(out.poseMs);
+  PROFILE_SCOPE_MS("detect/reproj", &out.reprojMs);
+  computeReprojectionError(out);
+}
+
+// Pyramidal Lucas-Kanade from the previous frame's corners into the current
+// frame, then back again. A corner that does not return to where it started
+// is considered lost, and a single lost corner fails the whole board.
+bool BoardDetector::trackCorners(const DetectorSettings &settings,
+                                 std::vector<cv::Point2f> &corners) {
+  PROFILE_SCOPE("detect/klt");
+  const cv::Size window(21, 21);
+  const int maxLevel = 3;
+  const cv::TermCriteria criteria(
+      cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 20, 0.03);
+
+  cv::calcOpticalFlowPyrLK(prevGray_, gray_, prevCorners_, corners, status_,
+                           flowError_, window, maxLevel, criteria);
+  cv::calcOpticalFlowPyrLK(gray_, prevGray_, corners, backtracked_,
+                           backStatus_, flowError_, window, maxLevel,
+                           criteria);
+
+  const float maxErrorSq = settings.maxFlowError * settings.maxFlowError;
+  for (size_t i = 0; i < corners.size(); ++i) {
+    if (!status_[i] || !backStatus_[i])
+      return false;
+    const cv::Point2f d = backtracked_[i] - prevCorners_[i];
+    if (d.x * d.x + d.y * d.y > maxErrorSq)
+      return false;
+  }
+  return true;
+}
+
+// Runs findChessboardCorners on `region` of the gray frame, downscaled to
+// pyramid `level`, and returns the corners in full-frame coordinates.
+bool BoardDetector::findCorners(const cv::Rect &region, int level, int flags,
+                                std::vector<cv::Point2f> &corners) {
+  auto t_start = std::chrono::high_resolution_clock::now();
+  cv::Mat view = gray_(region);
+  if (level > 0) {
+    PROFILE_SCOPE("detect/downscale");
+    const double scale = 1.0 / (1 << level);
+    cv::resize(view, coarse_, cv::Size(), scale, scale, cv::INTER_AREA);
+    view = coarse_;
+  }
+  PROFILE_TIMER(findTimer, "detect/find_corners");
+  bool found = cv::findChessboardCorners(view, boardSize_, corners, flags);
+  findTimer.stop();
+  stats_.levels[level].search.record(elapsedMs(t_start));
+  if (!found)
+    return false;
+
+  // Pixel centres: coarse pixel c covers full-resolution [c*f, (c+1)*f)
+  const float factor = static_cast<float>(1 << level);
+  const float offset = 0.5f * (factor - 1.0f);
+  for (cv::Point2f &corner : corners) {
+    corner.x = corner.x * factor + offset + region.x;
+    corner.y = corner.y * factor + offset + region.y;
+  }
+  return true;
+}
+
+// Coarsest level at which a board square stays large enough for
+// findChessboardCorners, judged from the previous detection.
+int BoardDetector::choosePyramidLevel(const DetectorSettings &settings) const {
+  if (settings.pyramidLevel >= 0)
+    return std::min(settings.pyramidLevel, kMaxPyramidLevel);
+  if (!hasPrevious_)
+    return 0;
+
+  const float minSquarePx = 12.0f;
+  int level = 0;
+  while (level < kMaxPyramidLevel &&
+         prevSquarePx_ / (2 << level) >= minSquarePx)
+    ++level;
+  return level;
+}
+
+// Bounding box of the previous corners, moved by the last frame-to-frame
+// motion and grown by the margin plus that motion.
+cv::Rect BoardDetector::predictRoi(cv::Size imageSize, float margin) const {
+  cv::Rect box = cv::boundingRect(prevCorners_);
+  box.x += cvRound(velocity_.x);
+  box.y += cvRound(velocity_.y);
+  const int border =
+      cvRound(margin * std::max(box.width, box.height) +
+              std::max(std::abs(velocity_.x), std::abs(velocity_.y)));
+  box.x -= border;
+  box.y -= border;
+  box.width += 2 * border;
+  box.height += 2 * border;
+  return box & cv::Rect(0, 0, imageSize.width, imageSize.height);
+}
+
+void BoardDetector::updateHistory(const BoardDetection &out) {
+  cv::Point2f centroid(0.0f, 0.0f);
+  for (const cv::Point2f &corner : out.corners)
+    centroid += corner;
+  centroid *= 1.0f / out.corners.size();
+
+  velocity_ = hasPrevious_ ? centroid - prevCentroid_ : cv::Point2f(0, 0);
+  prevCentroid_ = centroid;
+  prevCorners_ = out.corners;
+  hasPrevious_ = true;
+  out.rvec.copyTo(prevRvec_);
+  out.tvec.copyTo(prevTvec_);
+  prevReprojMean_ = out.reprojMean;
+  prevReprojMedian_ = out.reprojMedian;
+  prevReprojMax_ = out.reprojMax;
+
+  const cv::Rect box = cv::boundingRect(out.corners);
+  prevSquarePx_ =
+      std::min(box.width / float(boardSize_.width - 1),
+               box.height / float(boardSize_.height - 1));
+}
+
+void BoardDetector::printReport(std::ostream &os) const {
+  const uint64_t roiHits = stats_.roiHits, roiMisses = stats_.roiMisses;
+  const uint64_t fullHits = stats_.fullHits, fullMisses = stats_.fullMisses;
+  os << "Board detection:\n"
+     << "  full search: " << stats_.fullSearch.frames << " runs, "
+     << stats_.fullSearch.avgMs << " ms avg, hit rate "
+     << rate(fullHits, fullMisses) << "%\n"
+     << "  roi search:  " << stats_.roiSearch.frames << " runs, "
+     << stats_.roiSearch.avgMs << " ms avg, hit rate "
+     << rate(roiHits, roiMisses) << "%\n"
+     << "  klt tracking: " << stats_.tracking.frames << " runs, "
+     << stats_.tracking.avgMs << " ms avg, hit rate "
+     << rate(stats_.trackHits, stats_.trackLosses) << "%\n"
+     << "  pose (" << poseMethodName(settings().poseMethod)
+     << "): " << stats_.pose.frames << " solves, " << stats_.pose.avgMs
+     << " ms avg\n"
+     << "  frames from detector: " << fullHits + roiHits
+     << ", from tracker: " << stats_.trackHits << "\n";
+  if (stats_.gate.frames > 0)
+    os << "  motion gate: " << stats_.staticSkips << " static and "
+       << stats_.idleSkips << " idle frames skipped, "
+       << stats_.gate.avgMs << " ms avg per skip vs " << stats_.run.avgMs
+       << " ms per run, ~" << stats_.savedMs << " ms CPU saved\n";
+  for (int level = 0; level <= kMaxPyramidLevel; ++level) {
+    const DetectorStats::Level &l = stats_.levels[level];
+    if (l.search.frames == 0)
+      continue;
+    os << "  pyramid level " << level << " (1/" << (1 << level)
+       << "): " << l.search.frames << " searches, " << l.search.avgMs
+       << " ms avg, " << l.hits << " detections, reproj_mean "
+       << (l.hits ? l.reprojMeanSum / l.hits : 0.0) << " px\n";
+  }
+}
+
+// Reprojection error (pixels) between projected object points and detected
+// corners
+void BoardDetector::computeReprojectionError(BoardDetection &out) {
+  cv::projectPoints(objectPoints_, out.rvec, out.tvec, cameraMatrix_,
+                    distCoeffs_, projPoints_);
+  reprojErrors_.clear();
+  for (size_t i = 0; i < projPoints_.size(); ++i) {
+    double dx = projPoints_[i].x - out.corners[i].x;
+    double dy = projPoints_[i].y - out.corners[i].y;
+    reprojErrors_.push_back(std::sqrt(dx * dx + dy * dy));
+  }
+  if (reprojErrors_.empty())
+    return;
+
+  out.reprojMean =
+      std::accumulate(reprojErrors_.begin(), reprojErrors_.end(), 0.0) /
+      reprojErrors_.size();
+  out.reprojMax =
+      *std::max_element(reprojErrors_.begin(), reprojErrors_.end());
+  // Mean and max are taken first; nth_element may reorder in place
+  size_t mid = reprojErrors_.size() / 2;
+  std::nth_element(reprojErrors_.begin(), reprojErrors_.begin() + mid,
+                   reprojErrors_.end());
+  out.reprojMedian = reprojErrors_[mid];
+}
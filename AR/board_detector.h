@@ -0,0 +1,206 @@
+#pragma once
+
+#include "pose_estimator.h"
+#include "stage_stats.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <ostream>
+#include <vector>
+
+// How the corners of a frame were obtained.
+enum class DetectMode {
+  None,  // board not found
+  Full,  // findChessboardCorners over the whole frame
+  Roi,   // findChessboardCorners inside the region predicted from last frame
+  Track, // previous corners propagated with pyramidal Lucas-Kanade
+  Static, // image unchanged around the board, previous result reused
+};
+
+const int kDetectModeCount = 5;
+
+const char *detectModeName(DetectMode mode);
+
+// Coarsest image the detector searches on: level L is 1/2^L of full size.
+const int kMaxPyramidLevel = 2;
+
+// Result of looking for the chessboard in one camera frame.
+struct BoardDetection {
+  bool found = false;
+  std::vector<cv::Point2f> corners;
+  cv::Mat rvec, tvec;
+  // Reprojection error statistics in pixels, -1 when the board was not found
+  double reprojMean = -1.0, reprojMedian = -1.0, reprojMax = -1.0;
+  // Timestamp taken right after the pose solver returned
+  std::chrono::high_resolution_clock::time_point tPose;
+  double poseMs = 0.0;
+  DetectMode mode = DetectMode::None;
+  // The motion gate answered the frame without detecting: either Static, or
+  // an idle frame with no board in view (mode None, detectMs = gate cost)
+  bool gated = false;
+  // Pyramid level the board was found on, -1 if not detected this frame
+  int pyramidLevel = -1;
+  // Time spent finding and refining (or tracking) the corners, excluding
+  // solvePnP
+  double detectMs = 0.0;
+  // Breakdown: grayscale conversion, cornerSubPix and the reprojection
+  // error computation (0 when a step did not run)
+  double grayMs = 0.0, subPixMs = 0.0, reprojMs = 0.0;
+};
+
+// Knobs that may be changed from the GUI while the detector is running.
+struct DetectorSettings {
+  // Search only around the previous detection; full frame on a miss
+  bool roiSearch = true;
+  // Border added around the predicted board region, as a fraction of the
+  // board's larger side
+  float roiMargin = 0.25f;
+
+  // Search on a downscaled image and refine at full resolution: 0 = full
+  // resolution, 1 = half, 2 = quarter, -1 = pick from the board's size in
+  // the previous frame
+  int pyramidLevel = -1;
+
+  // Propagate the corners with KLT optical flow between full detections
+  bool tracking = false;
+  // Run the detector at least every this many frames while tracking
+  int redetectInterval = 10;
+
+  // findChessboardCorners flags (cv::CALIB_CB_*)
+  int chessboardFlags = cv::CALIB_CB_ADAPTIVE_THRESH |
+                        cv::CALIB_CB_NORMALIZE_IMAGE |
+                        cv::CALIB_CB_FAST_CHECK;
+  // cornerSubPix half window size and iteration limit
+  int subPixWindow = 11;
+  int subPixIterations = 30;
+  // Largest accepted forward-backward KLT error of any corner, in pixels
+  float maxFlowError = 0.5f;
+  // Largest accepted reprojection error of any tracked corner, in pixels
+  float maxTrackReprojError = 2.0f;
+
+  PoseMethod poseMethod = PoseMethod::Iterative;
+  // Seed the pose solver with the previous frame's pose
+  bool poseWarmStart = true;
+
+  // Compare each frame with the last one detection ran on, at 1/8 scale,
+  // and skip the work when nothing changed: around the board, the previous
+  // corners and pose are reused; without a board, the full search only runs
+  // every idleInterval frames
+  bool motionGate = false;
+  // Mean absolute gray-level difference (0-255) that counts as motion
+  float motionThreshold = 2.0f;
+  int idleInterval = 10;
+};
+
+// Counters for the GUI and the end-of-run report. Each search attempt is
+// recorded in the matching StageStats, whether it found the board or not.
+struct DetectorStats {
+  StageStats fullSearch;
+  StageStats roiSearch;
+  std::atomic<uint64_t> roiHits{0};
+  std::atomic<uint64_t> roiMisses{0};
+  std::atomic<uint64_t> fullHits{0};
+  std::atomic<uint64_t> fullMisses{0};
+  StageStats tracking;
+  std::atomic<uint64_t> trackHits{0};
+  // Tracking attempts rejected by the flow or reprojection check
+  std::atomic<uint64_t> trackLosses{0};
+  StageStats pose;
+
+  // Motion gate: the cost of the frames it skipped and of the detect() calls
+  // that did run, the skipped frames and the CPU time that saved (estimated
+  // from the average run)
+  StageStats gate;
+  StageStats run;
+  std::atomic<uint64_t> staticSkips{0};
+  std::atomic<uint64_t> idleSkips{0};
+  std::atomic<double> savedMs{0.0};
+
+  // Coarse-to-fine search per pyramid level: search time (including the
+  // downscale), successful searches and the resulting reprojection error
+  struct Level {
+    StageStats search;
+    std::atomic<uint64_t> hits{0};
+    std::atomic<double> reprojMeanSum{0.0};
+  } levels[kMaxPyramidLevel + 1];
+};
+
+// Chessboard detection and pose estimation for the AR view.
+//
+// Owns everything needed to turn a BGR camera frame into a board pose:
+// grayscale conversion, corner detection and refinement, pose estimation
+// and the reprojection error used in the measurement log. detect() is meant
+// to be called from a single thread; settings and stats may be accessed from
+// any.
+class BoardDetector {
+public:
+  BoardDetector(cv::Size boardSize, float squareSize, const cv::Mat &cameraMatrix,
+                const cv::Mat &distCoeffs);
+
+  // Looks for the board in `frame` (BGR, un-flipped). Returns out.found.
+  bool detect(const cv::Mat &frame, BoardDetection &out);
+
+  DetectorSettings settings() const;
+  void setSettings(const DetectorSettings &settings);
+
+  const DetectorStats &stats() const { return stats_; }
+  void printReport(std::ostream &os) const;
+
+  cv::Size boardSize() const { return boardSize_; }
+  const std::vector<cv::Point3f> &objectPoints() const { return objectPoints_; }
+
+private:
+  bool findCorners(const cv::Rect &region, int level, int flags,
+                   std::vector<cv::Point2f> &corners);
+  int choosePyramidLevel(const DetectorSettings &settings) const;
+  bool trackCorners(const DetectorSettings &settings,
+                    std::vector<cv::Point2f> &corners);
+  bool skipUnchanged(const cv::Mat &frame, const DetectorSettings &settings,
+                     BoardDetection &out);
+  bool detectChanged(const cv::Mat &frame, const DetectorSettings &settings,
+                     BoardDetection &out);
+  void estimatePose(const DetectorSettings &settings, BoardDetection &out);
+  cv::Rect predictRoi(cv::Size imageSize, float margin) const;
+  void updateHistory(const BoardDetection &out);
+  void computeReprojectionError(BoardDetection &out);
+
+  cv::Size boardSize_;
+  std::vector<cv::Point3f> objectPoints_;
+  cv::Mat cameraMatrix_, distCoeffs_;
+  PoseEstimator pose_;
+  cv::Mat gray_, prevGray_;
+  cv::Mat coarse_; // downscaled search image
+
+  mutable std::mutex settingsMutex_;
+  DetectorSettings settings_;
+  DetectorStats stats_;
+
+  // Previous successful detection, used to predict where to search next
+  bool hasPrevious_ = false;
+  std::vector<cv::Point2f> prevCorners_;
+  cv::Point2f prevCentroid_;
+  cv::Point2f velocity_; // centroid motion per frame
+  float prevSquarePx_ = 0.0f; // apparent size of one board square
+  int framesSinceDetect_ = 0;
+  // Result reused on frames the motion gate skips
+  cv::Mat prevRvec_, prevTvec_;
+  double prevReprojMean_ = -1.0, prevReprojMedian_ = -1.0,
+         prevReprojMax_ = -1.0;
+
+  // Motion gate: 1/8-scale gray of this frame and of the last frame
+  // detection ran on
+  cv::Mat motionColor_, motionSmall_, motionRef_;
+  int idleSkipped_ = 0;
+
+  // Reprojection scratch buffers, sized once for the board
+  std::vector<cv::Point2f> projPoints_;
+  std::vector<double> reprojErrors_;
+
+  // KLT scratch buffers
+  std::vector<cv::Point2f> backtracked_;
+  std::vector<unsigned char> status_, backStatus_;
+  std::vector<float> flowError_;
+};
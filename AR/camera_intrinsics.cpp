@@ -0,0 +1,249 @@
+#include "camera_intrinsics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+namespace {
+// Binary calibration cache: header, the calibrated matrices as raw
+// doubles, then one entry per capture size derived so far.
+struct CacheHeader {
+  char magic[4] = {'A', 'R', 'I', 'C'};
+  uint32_t version = 2;
+  uint64_t sourceHash = 0; // FNV-1a of the calibration file's bytes
+  int32_t calibratedWidth = 0, calibratedHeight = 0;
+  uint32_t distCount = 0;
+  float nearPlane = 0.0f, farPlane = 0.0f;
+  uint32_t entryCount = 0;
+};
+
+struct CacheEntry {
+  int32_t captureWidth = 0, captureHeight = 0;
+  double cameraMatrix[9];
+  float projection[16];
+};
+
+// Enough for the calibrated size plus the few resolutions a camera is
+// actually run at; the oldest entry makes room for a new one
+const uint32_t kMaxCacheEntries = 8;
+
+// Lengths calibrateCamera can produce (k1..p2, +k3, +k4..k6, +s1..s4,
+// +tauX/Y); anything else is not a cache this code wrote
+bool validDistCount(uint32_t n) {
+  return n == 4 || n == 5 || n == 8 || n == 12 || n == 14;
+}
+
+uint64_t fnv1a(const std::vector<char> &bytes) {
+  uint64_t hash = 14695981039346656037ull;
+  for (char c : bytes) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+void writeMat(std::ostream &os, const cv::Mat &m) {
+  os.write(reinterpret_cast<const char *>(m.ptr<double>()),
+           m.total() * sizeof(double));
+}
+
+bool readMat(std::istream &is, int rows, int cols, cv::Mat &m) {
+  m.create(rows, cols, CV_64F);
+  return bool(is.read(reinterpret_cast<char *>(m.ptr<double>()),
+                      m.total() * sizeof(double)));
+}
+
+// Returns false unless the cache was made from the file with `hash`.
+// `entries` stay empty if they were made for other clip planes.
+bool readCache(const std::string &cachePath, uint64_t hash,
+               CameraIntrinsics &calibrated,
+               std::vector<CacheEntry> &entries) {
+  std::ifstream in(cachePath, std::ios::binary);
+  CacheHeader expected, header;
+  if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      std::memcmp(header.magic, expected.magic, 4) != 0 ||
+      header.version != expected.version || header.sourceHash != hash ||
+      !validDistCount(header.distCount) ||
+      header.entryCount > kMaxCacheEntries || header.calibratedWidth <= 0 ||
+      header.calibratedHeight <= 0)
+    return false;
+
+  calibrated.imageSize =
+      cv::Size(header.calibratedWidth, header.calibratedHeight);
+  if (!readMat(in, 3, 3, calibrated.cameraMatrix) ||
+      !readMat(in, header.distCount, 1, calibrated.distCoeffs))
+    return false;
+  if (header.nearPlane != kNearPlane || header.farPlane != kFarPlane)
+    return true;
+  entries.resize(header.entryCount);
+  if (!in.read(reinterpret_cast<char *>(entries.data()),
+               entries.size() * sizeof(CacheEntry)))
+    entries.clear(); // truncated: the matrices above are still good
+  return true;
+}
+
+void writeCache(const std::string &cachePath, uint64_t hash,
+                const CameraIntrinsics &calibrated,
+                const std::vector<CacheEntry> &entries) {
+  std::ofstream os(cachePath, std::ios::binary);
+  if (!os.is_open())
+    return; // read-only location: the next start parses the XML again
+  CacheHeader header;
+  header.sourceHash = hash;
+  header.calibratedWidth = calibrated.imageSize.width;
+  header.calibratedHeight = calibrated.imageSize.height;
+  header.distCount = static_cast<uint32_t>(calibrated.distCoeffs.total());
+  header.nearPlane = kNearPlane;
+  header.farPlane = kFarPlane;
+  header.entryCount = static_cast<uint32_t>(entries.size());
+  os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  writeMat(os, calibrated.cameraMatrix);
+  writeMat(os, calibrated.distCoeffs);
+  os.write(reinterpret_cast<const char *>(entries.data()),
+           entries.size() * sizeof(CacheEntry));
+}
+
+bool parseCalibration(const std::string &path, CameraIntrinsics &out) {
+  cv::FileStorage fs(path, cv::FileStorage::READ);
+  if (!fs.isOpened()) {
+    std::cerr << "Cannot open calibration " << path << "\n";
+    return false;
+  }
+  int width = 0, height = 0;
+  fs["image_width"] >> width;
+  fs["image_height"] >> height;
+  cv::Mat K, D;
+  fs["camera_matrix"] >> K;
+  fs["distortion_coefficients"] >> D;
+  if (K.rows != 3 || K.cols != 3 || D.empty() || width <= 0 || height <= 0) {
+    std::cerr << path << " has no camera_matrix, distortion_coefficients "
+              << "and image size\n";
+    return false;
+  }
+  out.imageSize = cv::Size(width, height);
+  K.convertTo(out.cameraMatrix, CV_64F);
+  D.reshape(1, static_cast<int>(D.total())).convertTo(out.distCoeffs, CV_64F);
+  return true;
+}
+
+void derive(cv::Size captureSize, CalibrationData &data) {
+  data.scaled = scaleIntrinsics(data.calibrated, captureSize);
+  glProjection(data.scaled, kNearPlane, kFarPlane, data.projection);
+}
+} // namespace
+
+CameraIntrinsics defaultIntrinsics() {
+  CameraIntrinsics intrinsics;
+  intrinsics.imageSize = cv::Size(1920, 1080);
+  intrinsics.cameraMatrix =
+      (cv::Mat_<double>(3, 3) << 2218.397864043568, 0., 959.5, 0.,
+       2218.397864043568, 539.5, 0., 0., 1.);
+  intrinsics.distCoeffs =
+      (cv::Mat_<double>(5, 1) << -0.17611576780242291, 1.7357972971751359,
+       0., 0., -5.4837634455342661);
+  return intrinsics;
+}
+
+CameraIntrinsics scaleIntrinsics(const CameraIntrinsics &in, cv::Size size) {
+  CameraIntrinsics out;
+  out.distCoeffs = in.distCoeffs.clone();
+  out.cameraMatrix = in.cameraMatrix.clone();
+  if (size.area() == 0 || size == in.imageSize) {
+    out.imageSize = in.imageSize;
+    return out;
+  }
+  const double sx = double(size.width) / in.imageSize.width;
+  const double sy = double(size.height) / in.imageSize.height;
+  if (std::abs(sx - sy) > 0.01)
+    std::cerr << "Capture " << size << " has a different aspect ratio than "
+              << "the calibration " << in.imageSize
+              << "; the intrinsics will be off\n";
+  cv::Mat &K = out.cameraMatrix;
+  K.at<double>(0, 0) *= sx;
+  K.at<double>(1, 1) *= sy;
+  K.at<double>(0, 2) = (K.at<double>(0, 2) + 0.5) * sx - 0.5;
+  K.at<double>(1, 2) = (K.at<double>(1, 2) + 0.5) * sy - 0.5;
+  out.imageSize = size;
+  return out;
+}
+
+void glProjection(const CameraIntrinsics &intrinsics, float nearPlane,
+                  float farPlane, float out[16]) {
+  const cv::Mat &K = intrinsics.cameraMatrix;
+  const float fx = K.at<double>(0, 0);
+  const float fy = K.at<double>(1, 1);
+  const float cx = K.at<double>(0, 2);
+  const float cy = K.at<double>(1, 2);
+  const float width = intrinsics.imageSize.width;
+  const float height = intrinsics.imageSize.height;
+
+  // out[column * 4 + row]
+  std::fill(out, out + 16, 0.0f);
+  out[0] = 2.0f * fx / width;
+  out[5] = 2.0f * fy / height;
+  out[8] = 1.0f - (2.0f * cx) / width;
+  out[9] = (2.0f * cy) / height - 1.0f; // Flipped for OpenGL's Y-up system
+  out[10] = -(farPlane + nearPlane) / (farPlane - nearPlane);
+  out[11] = -1.0f;
+  out[14] = -2.0f * farPlane * nearPlane / (farPlane - nearPlane);
+}
+
+bool loadCalibration(const std::string &path, cv::Size captureSize,
+                     CalibrationData &out) {
+  out.fromCache = false;
+  if (path.empty()) {
+    out.calibrated = defaultIntrinsics();
+    derive(captureSize, out);
+    return true;
+  }
+
+  std::ifstream in(path, std::ios::binary);
+  if (!in.is_open()) {
+    std::cerr << "Cannot open calibration " << path << "\n";
+    return false;
+  }
+  const std::vector<char> bytes((std::istreambuf_iterator<char>(in)),
+                                std::istreambuf_iterator<char>());
+  const uint64_t hash = fnv1a(bytes);
+  const std::string cachePath = path + ".arcache";
+
+  std::vector<CacheEntry> entries;
+  const bool cached = readCache(cachePath, hash, out.calibrated, entries);
+  if (!cached && !parseCalibration(path, out.calibrated))
+    return false;
+
+  const cv::Size size =
+      captureSize.area() ? captureSize : out.calibrated.imageSize;
+  for (const CacheEntry &entry : entries) {
+    if (entry.captureWidth != size.width || entry.captureHeight != size.height)
+      continue;
+    out.scaled.imageSize = size;
+    out.scaled.cameraMatrix =
+        cv::Mat(3, 3, CV_64F, const_cast<double *>(entry.cameraMatrix)).clone();
+    out.scaled.distCoeffs = out.calibrated.distCoeffs.clone();
+    std::copy(entry.projection, entry.projection + 16, out.projection);
+    out.fromCache = true;
+    return true;
+  }
+
+  derive(size, out);
+  CacheEntry entry;
+  entry.captureWidth = size.width;
+  entry.captureHeight = size.height;
+  std::copy(out.scaled.cameraMatrix.ptr<double>(),
+            out.scaled.cameraMatrix.ptr<double>() + 9, entry.cameraMatrix);
+  std::copy(out.projection, out.projection + 16, entry.projection);
+  if (entries.size() >= kMaxCacheEntries)
+    entries.erase(entries.begin());
+  entries.push_back(entry);
+  // readCache() would reject a distortion vector of any other length
+  const uint32_t distCount =
+      static_cast<uint32_t>(out.calibrated.distCoeffs.total());
+  if (validDistCount(distCount))
+    writeCache(cachePath, hash, out.calibrated, entries);
+  return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include <string>
+
+// Pinhole intrinsics and the resolution they were estimated at.
+struct CameraIntrinsics {
+  cv::Size imageSize;
+  cv::Mat cameraMatrix; // 3x3 CV_64F
+  cv::Mat distCoeffs;   // Nx1 CV_64F
+};
+
+// Everything AR derives from a calibration for one capture resolution.
+struct CalibrationData {
+  CameraIntrinsics calibrated; // as stored in the calibration file
+  CameraIntrinsics scaled;     // for the capture resolution
+  // OpenGL projection matching `scaled`, column-major (glm::make_mat4)
+  float projection[16];
+  bool fromCache = false;
+};
+
+const float kNearPlane = 0.01f;
+const float kFarPlane = 100.0f;
+
+// The calibration the AR demo was developed with (1920x1080).
+CameraIntrinsics defaultIntrinsics();
+
+// Same camera for frames of `size`: focal lengths and principal point are
+// scaled about pixel centres. Distortion coefficients work on normalized
+// coordinates and do not change. An empty `size` returns `in` unchanged.
+CameraIntrinsics scaleIntrinsics(const CameraIntrinsics &in, cv::Size size);
+
+// Projection for rendering over the (un-flipped) camera image.
+void glProjection(const CameraIntrinsics &intrinsics, float nearPlane,
+                  float farPlane, float out[16]);
+
+// Loads the camera_matrix, distortion_coefficients and image size that
+// CameraCalibration's saveCameraParams writes, and derives `out` for a
+// capture of `captureSize` (empty: the calibrated size). An empty path
+// selects defaultIntrinsics().
+//
+// Parsing FileStorage XML is slow compared to everything else at startup,
+// so the result is cached in `path` + ".arcache". The cache is keyed on a
+// hash of the XML bytes and used only while that still matches. Derived
+// data are kept per capture size (up to 8), so the calibrated size and the
+// camera's own resolution both hit once seen. Returns false, after printing
+// why, if the file cannot be read.
+bool loadCalibration(const std::string &path, cv::Size captureSize,
+                     CalibrationData &out);
@@ -0,0 +1,191 @@
+#include "frame_pipeline.h"
+
+#include "alloc_counter.h"
+#include "common/profiler.h"
+
+namespace {
+double elapsedMs(PipelineClock::time_point from, PipelineClock::time_point to) {
+  return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+// How long a stage sleeps when its input is empty or its output is full
+const auto kIdleWait = std::chrono::microseconds(200);
+} // namespace
+
+FramePipeline::FramePipeline(FrameSource &source, BoardDetector &detector,
+                             size_t queueDepth, bool cpuConvert)
+    : source_(source), detector_(detector), captureQueue_(queueDepth),
+      resultQueue_(queueDepth),
+      // Both queues full plus one packet held by each of the three threads
+      recycleQueue_(2 * queueDepth + 3), cpuConvert_(cpuConvert) {}
+
+FramePipeline::~FramePipeline() { stop(); }
+
+void FramePipeline::start() {
+  if (running_)
+    return;
+  running_ = true;
+  captureDone_ = false;
+  detectDone_ = false;
+  captureThread_ = std::thread(&FramePipeline::captureLoop, this);
+  detectThread_ = std::thread(&FramePipeline::detectLoop, this);
+}
+
+void FramePipeline::stop() {
+  running_ = false;
+  source_.close();
+  if (captureThread_.joinable())
+    captureThread_.join();
+  if (detectThread_.joinable())
+    detectThread_.join();
+}
+
+bool FramePipeline::tryPopLatest(FramePacket &out) {
+  bool got = false;
+  // incoming_ is always a moved-from (empty) packet here, so popping into it
+  // releases nothing; the displaced packet travels back whole
+  while (resultQueue_.tryPop(incoming_)) {
+    if (got) {
+      ++skipped_;
+      // The older packet never reaches the consumer: carry its drops, and
+      // itself, over to the newer one
+      incoming_.dropped += out.dropped + 1;
+    }
+    got = true;
+    std::swap(out, incoming_);
+    recycleQueue_.tryPush(std::move(incoming_));
+  }
+  return got;
+}
+
+bool FramePipeline::tryPop(FramePacket &out) {
+  if (!resultQueue_.tryPop(incoming_))
+    return false;
+  std::swap(out, incoming_);
+  recycleQueue_.tryPush(std::move(incoming_));
+  return true;
+}
+
+bool FramePipeline::finished() const {
+  return detectDone_ && resultQueue_.empty();
+}
+
+void FramePipeline::captureLoop() {
+  Profiler::setThreadName("capture");
+  CapturedFrame captured;
+  FramePacket packet;
+  while (running_) {
+    // A latest-frame source only gets asked once detection can take the
+    // frame, otherwise it would sit in the queue and go stale there instead
+    if (source_.dropsStaleFrames()) {
+      while (running_ && captureQueue_.size() >= captureQueue_.capacity())
+        std::this_thread::sleep_for(kIdleWait);
+    }
+
+    // Reuse a packet the render thread is done with; until the pool has
+    // filled up, `packet` is a fresh (moved-from) one
+    recycleQueue_.tryPop(packet);
+    const uint64_t allocsBefore = threadAllocationCount();
+
+    auto t_start = PipelineClock::now();
+    captured.frame = std::move(packet.frame);
+    captured.borrowed = false;
+    PROFILE_TIMER(readTimer, "capture/read");
+    if (!source_.read(captured))
+      break;
+    Profiler::setFrame(captured.sequence);
+    readTimer.stop();
+    packet.readMs = elapsedMs(t_start, PipelineClock::now());
+    captureStats_.record(packet.readMs);
+
+    packet.frame = std::move(captured.frame);
+    packet.index = captured.sequence;
+    packet.dropped = captured.dropped;
+    packet.borrowed = captured.borrowed;
+    packet.tCapture = captured.tCapture;
+    captureStats_.allocations = threadAllocationCount() - allocsBefore;
+
+    // Back-pressure: wait for detection rather than growing the queue
+    bool stalled = false;
+    while (running_ && !captureQueue_.tryPush(std::move(packet))) {
+      stalled = true;
+      std::this_thread::sleep_for(kIdleWait);
+    }
+    if (stalled)
+      ++captureStats_.stalls;
+  }
+  captureDone_ = true;
+}
+
+void FramePipeline::detectLoop() {
+  Profiler::setThreadName("detect");
+  FramePacket packet;
+  // Frames this stage handled; packet.index has gaps with a latest-frame
+  // source and would sample the conversion rarely or never
+  uint64_t processed = 0;
+  while (running_) {
+    if (!captureQueue_.tryPop(packet)) {
+      // The capture thread publishes its last frame before raising the flag
+      if (captureDone_ && captureQueue_.empty())
+        break;
+      std::this_thread::sleep_for(kIdleWait);
+      continue;
+    }
+    Profiler::setFrame(packet.index);
+
+    const uint64_t allocsBefore = threadAllocationCount();
+    auto t_start = PipelineClock::now();
+    detector_.detect(packet.frame, packet.detection);
+    packet.tPnp =
+        packet.detection.found ? packet.detection.tPose : packet.tCapture;
+
+    if (undistort_) {
+      PROFILE_SCOPE("detect/undistort");
+      auto t_undistort = PipelineClock::now();
+      undistort_->apply(packet.frame, packet.undistorted);
+      if (packet.borrowed) {
+        // Swapping would leave the source's view in `undistorted`, and the
+        // next remap into it would write into the source's memory
+        packet.frame = packet.undistorted;
+        packet.borrowed = false;
+      } else {
+        std::swap(packet.frame, packet.undistorted);
+      }
+      undistortStats_.record(elapsedMs(t_undistort, PipelineClock::now()));
+    }
+
+    // Convert the color frame to RGB and flip it vertically for OpenGL, so
+    // the GL thread only has to upload it. Going through a second buffer
+    // avoids the temporary copy an in-place cvtColor makes. The sampled
+    // run leaves packet.frame alone and flips the scratch copy in place, as
+    // does a borrowed frame, which then points at the scratch buffer.
+    packet.convertMs = 0.0;
+    if (cpuConvert_ || processed++ % kConvertSampleInterval == 0) {
+      PROFILE_SCOPE("detect/convert");
+      auto t_convert = PipelineClock::now();
+      cv::cvtColor(packet.frame, packet.scratch, cv::COLOR_BGR2RGB);
+      const bool intoFrame = cpuConvert_ && !packet.borrowed;
+      cv::flip(packet.scratch, intoFrame ? packet.frame : packet.scratch, 0);
+      if (cpuConvert_ && packet.borrowed) {
+        // Shares the buffer; capture drops this reference on the next read
+        packet.frame = packet.scratch;
+        packet.borrowed = false;
+      }
+      const double convertMs = elapsedMs(t_convert, PipelineClock::now());
+      convertStats_.record(convertMs);
+      if (cpuConvert_)
+        packet.convertMs = convertMs;
+    }
+    detectStats_.record(elapsedMs(t_start, PipelineClock::now()));
+    detectStats_.allocations = threadAllocationCount() - allocsBefore;
+
+    bool stalled = false;
+    while (running_ && !resultQueue_.tryPush(std::move(packet))) {
+      stalled = true;
+      std::this_thread::sleep_for(kIdleWait);
+    }
+    if (stalled)
+      ++detectStats_.stalls;
+  }
+  detectDone_ = true;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "board_detector.h"
+#include "common/undistort_maps.h"
+#include "frame_source.h"
+#include "spsc_queue.h"
+#include "stage_stats.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include <thread>
+
+using PipelineClock = std::chrono::high_resolution_clock;
+
+// One camera frame travelling capture -> detection -> render.
+struct FramePacket {
+  uint64_t index = 0;
+  // Frames discarded right before this one, by the capture front-end or,
+  // after tryPopLatest(), by the render thread
+  uint64_t dropped = 0;
+  // BGR as captured. With CPU conversion the detection stage turns it into
+  // RGB flipped for OpenGL once the board search is done; otherwise it is
+  // handed to the GL thread untouched and the screen shader does both.
+  cv::Mat frame;
+  // `frame` is a view the source lent (CapturedFrame::borrowed): results
+  // then go into the packet's own buffers and `frame` is pointed at them
+  bool borrowed = false;
+  // Colour conversion target of the detection stage, kept with the packet
+  // so its buffer is reused as well
+  cv::Mat scratch;
+  // Undistortion target; swapped with `frame` once it is filled, or shared
+  // with it when `frame` was borrowed
+  cv::Mat undistorted;
+  // Time FrameSource::read() took to deliver this frame
+  double readMs = 0.0;
+  // CPU time the detection stage spent converting this frame for OpenGL
+  double convertMs = 0.0;
+  PipelineClock::time_point tCapture;
+  PipelineClock::time_point tPnp;
+  BoardDetection detection;
+};
+
+// Capture and detection running on their own threads.
+//
+//   capture thread --[captureQueue]--> detection thread --[resultQueue]--> GL
+//
+// The GL thread polls tryPopLatest() once per rendered frame and keeps
+// drawing the previous frame/pose when nothing new has arrived, so render
+// rate no longer depends on how long findChessboardCorners takes.
+//
+// Packets are pooled: whatever tryPopLatest() replaces goes back to the
+// capture thread through recycleQueue, and its frame, conversion buffer and
+// corner vector are filled in place next time. Once every packet in the pool
+// has made one round trip, frames flow without new buffers being allocated.
+class FramePipeline {
+public:
+  // `cpuConvert` selects whether frames leave the pipeline as RGB flipped
+  // for OpenGL or as the raw BGR capture.
+  FramePipeline(FrameSource &source, BoardDetector &detector,
+                size_t queueDepth, bool cpuConvert = true);
+  ~FramePipeline();
+
+  // Hands frames out undistorted: after detection, which still works on
+  // the raw image and its distortion model, the detection thread remaps
+  // each frame through `maps`. Call before start(); `maps` must outlive the
+  // pipeline and not change while it runs.
+  void setUndistortion(const UndistortMaps *maps) { undistort_ = maps; }
+
+  void start();
+  // Joins both stage threads; also closes the frame source so a blocked
+  // read() returns.
+  void stop();
+
+  // Pops every finished frame and hands back only the newest one. Older
+  // frames are counted in skippedFrames() and, with their own drops, added
+  // to the returned packet's `dropped`. The packet previously held in
+  // `out` and any skipped ones are returned to the pool. Returns false if
+  // none is ready.
+  bool tryPopLatest(FramePacket &out);
+  // Pops the oldest finished frame, skipping nothing; for consumers that
+  // need every frame, like the replay benchmark. Recycles `out` the same way.
+  bool tryPop(FramePacket &out);
+
+  // True once the capture source ran dry and every frame has been consumed.
+  bool finished() const;
+
+  size_t captureQueueDepth() const { return captureQueue_.size(); }
+  size_t resultQueueDepth() const { return resultQueue_.size(); }
+  size_t queueCapacity() const { return captureQueue_.capacity(); }
+  uint64_t skippedFrames() const { return skipped_; }
+
+  const StageStats &captureStats() const { return captureStats_; }
+  const StageStats &detectStats() const { return detectStats_; }
+  // BGR -> RGB plus flip on the detection thread. Without CPU conversion
+  // it is still run on every kConvertSampleInterval-th frame the stage
+  // processes, into a buffer nobody uses, so the time the shader path saves
+  // stays known.
+  const StageStats &convertStats() const { return convertStats_; }
+  bool cpuConvert() const { return cpuConvert_; }
+  const StageStats &undistortStats() const { return undistortStats_; }
+
+  static const uint64_t kConvertSampleInterval = 100;
+
+private:
+  void captureLoop();
+  void detectLoop();
+
+  FrameSource &source_;
+  BoardDetector &detector_;
+
+  SpscQueue<FramePacket> captureQueue_;
+  SpscQueue<FramePacket> resultQueue_;
+  // Render thread -> capture thread; big enough for every packet in flight
+  SpscQueue<FramePacket> recycleQueue_;
+  FramePacket incoming_; // render thread only
+
+  StageStats captureStats_;
+  StageStats detectStats_;
+  StageStats convertStats_;
+  StageStats undistortStats_;
+  const bool cpuConvert_;
+  const UndistortMaps *undistort_ = nullptr;
+  uint64_t skipped_ = 0;
+
+  std::atomic<bool> running_{false};
+  std::atomic<bool> captureDone_{false};
+  std::atomic<bool> detectDone_{false};
+  std::thread captureThread_;
+  std::thread detectThread_;
+};
@@ -0,0 +1,273 @@
+#include "frame_recording.h"
+
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+uint64_t alignUp(uint64_t offset) {
+  return (offset + kRecordingAlignment - 1) / kRecordingAlignment *
+         kRecordingAlignment;
+}
+
+const char kPadding[kRecordingAlignment] = {};
+} // namespace
+
+FrameRecorder::FrameRecorder(const std::string &path)
+    : path_(path), out_(path, std::ios::binary) {
+  isOpen_ = out_.is_open();
+  if (!isOpen_) {
+    std::cerr << "Failed to open recording: " << path << "\n";
+    return;
+  }
+  // Placeholder until the frame count and index position are known
+  out_.write(reinterpret_cast<const char *>(&header_), sizeof(header_));
+  offset_ = sizeof(header_);
+}
+
+FrameRecorder::~FrameRecorder() {
+  if (!isOpen_)
+    return;
+  header_.frameCount = index_.size();
+  header_.indexOffset = alignUp(offset_);
+  out_.write(kPadding, header_.indexOffset - offset_);
+  out_.write(reinterpret_cast<const char *>(index_.data()),
+             index_.size() * sizeof(RecordingIndexEntry));
+  out_.seekp(0);
+  out_.write(reinterpret_cast<const char *>(&header_), sizeof(header_));
+  if (!out_)
+    std::cerr << "Failed to finish recording: " << path_ << "\n";
+}
+
+bool FrameRecorder::write(const CapturedFrame &frame) {
+  const cv::Mat &image = frame.frame;
+  if (!isOpen_ || image.empty())
+    return false;
+  if (index_.empty()) {
+    header_.width = image.cols;
+    header_.height = image.rows;
+    header_.type = image.type();
+    header_.stride = static_cast<uint32_t>(image.cols * image.elemSize());
+    tFirst_ = frame.tCapture;
+  } else if (image.cols != header_.width || image.rows != header_.height ||
+             image.type() != header_.type) {
+    return false;
+  }
+
+  const uint64_t start = alignUp(offset_);
+  out_.write(kPadding, start - offset_);
+  if (image.isContinuous()) {
+    out_.write(reinterpret_cast<const char *>(image.data),
+               image.total() * image.elemSize());
+  } else {
+    for (int y = 0; y < image.rows; ++y)
+      out_.write(reinterpret_cast<const char *>(image.ptr(y)), header_.stride);
+  }
+
+  RecordingIndexEntry entry;
+  entry.offset = start;
+  entry.size = uint64_t(header_.stride) * header_.height;
+  entry.tCaptureNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         frame.tCapture - tFirst_)
+                         .count();
+  entry.sequence = frame.sequence;
+  entry.dropped = frame.dropped;
+  index_.push_back(entry);
+  offset_ = start + entry.size;
+  return bool(out_);
+}
+
+RecordingSource::RecordingSource(std::unique_ptr<FrameSource> inner,
+                                 const std::string &path)
+    : inner_(std::move(inner)), recorder_(path) {}
+
+bool RecordingSource::read(CapturedFrame &out) {
+  if (!inner_->read(out))
+    return false;
+  recorder_.write(out);
+  return true;
+}
+
+RecordedSource::RecordedSource(const std::string &path, uint64_t frames,
+                               bool realtime)
+    : limit_(frames), realtime_(realtime) {
+  if (!map(path))
+    return;
+
+  const RecordingHeader expected;
+  if (size_ < sizeof(header_)) {
+    std::cerr << path << " is not a frame recording\n";
+    unmap();
+    return;
+  }
+  std::memcpy(&header_, data_, sizeof(header_));
+  const uint64_t frameBytes = uint64_t(header_.stride) * header_.height;
+  // The writer only stores tightly packed 8-bit frames; anything else would
+  // describe a Mat view that does not fit its rows
+  const int channels = CV_MAT_CN(header_.type);
+  const bool layout =
+      header_.width > 0 && header_.height > 0 && channels <= 4 &&
+      header_.type == CV_MAKETYPE(CV_8U, channels) &&
+      uint64_t(header_.stride) == uint64_t(header_.width) * channels;
+  bool valid = layout && std::memcmp(header_.magic, expected.magic, 4) == 0 &&
+               header_.version == expected.version &&
+               header_.headerSize == expected.headerSize &&
+               header_.compression == 0 && header_.indexOffset <= size_ &&
+               header_.frameCount <= (size_ - header_.indexOffset) /
+                                         sizeof(RecordingIndexEntry);
+  if (valid) {
+    index_ = reinterpret_cast<const RecordingIndexEntry *>(
+        data_ + header_.indexOffset);
+    for (uint64_t i = 0; valid && i < header_.frameCount; ++i)
+      valid = index_[i].size == frameBytes &&
+              index_[i].offset + frameBytes <= header_.indexOffset;
+  }
+  if (!valid) {
+    std::cerr << path << " is not a valid frame recording\n";
+    index_ = nullptr;
+    unmap();
+    return;
+  }
+  if (limit_ == 0 || header_.frameCount == 0)
+    limit_ = header_.frameCount;
+}
+
+RecordedSource::~RecordedSource() { unmap(); }
+
+cv::Size RecordedSource::frameSize() const {
+  return cv::Size(header_.width, header_.height);
+}
+
+bool RecordedSource::read(CapturedFrame &out) {
+  if (closed_ || !index_ || next_ >= limit_)
+    return false;
+  const uint64_t i = next_ % header_.frameCount;
+  const RecordingIndexEntry &entry = index_[i];
+
+  if (realtime_) {
+    if (i == 0)
+      tStart_ = std::chrono::high_resolution_clock::now();
+    // Short sleeps so close() is noticed even across a long recorded gap
+    const auto due = tStart_ + std::chrono::nanoseconds(entry.tCaptureNs);
+    while (!closed_ && std::chrono::high_resolution_clock::now() < due)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  out.frame = cv::Mat(header_.height, header_.width, header_.type,
+                      data_ + entry.offset, header_.stride);
+  out.borrowed = true;
+  out.tCapture = std::chrono::high_resolution_clock::now();
+  out.sequence = next_++;
+  out.dropped = entry.dropped;
+  return true;
+}
+
+#ifdef _WIN32
+bool RecordedSource::map(const std::string &path) {
+  file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                      OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  LARGE_INTEGER size;
+  if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &size)) {
+    std::cerr << "Cannot open " << path << "\n";
+    file_ = nullptr;
+    return false;
+  }
+  size_ = static_cast<size_t>(size.QuadPart);
+  mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping_)
+    data_ = static_cast<unsigned char *>(
+        MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+  if (!data_) {
+    std::cerr << "Cannot map " << path << "\n";
+    unmap();
+    return false;
+  }
+  return true;
+}
+
+void RecordedSource::unmap() {
+  if (data_)
+    UnmapViewOfFile(data_);
+  if (mapping_)
+    CloseHandle(mapping_);
+  if (file_)
+    CloseHandle(file_);
+  data_ = nullptr;
+  mapping_ = file_ = nullptr;
+  size_ = 0;
+}
+#else
+bool RecordedSource::map(const std::string &path) {
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || ::fstat(fd, &st) != 0) {
+    std::cerr << "Cannot open " << path << "\n";
+    if (fd >= 0)
+      ::close(fd);
+    return false;
+  }
+  size_ = static_cast<size_t>(st.st_size);
+  void *data = size_ ? ::mmap(nullptr, size_, PROT_READ,
+                              MAP_PRIVATE, fd, 0)
+                     : MAP_FAILED;
+  ::close(fd); // the mapping keeps the file referenced
+  if (data == MAP_FAILED) {
+    std::cerr << "Cannot map " << path << "\n";
+    size_ = 0;
+    return false;
+  }
+  data_ = static_cast<unsigned char *>(data);
+  // Frames are read front to back
+  ::madvise(data_, size_, MADV_SEQUENTIAL);
+  return true;
+}
+
+void RecordedSource::unmap() {
+  if (data_)
+    ::munmap(data_, size_);
+  data_ = nullptr;
+  size_ = 0;
+}
+#endif
+
+bool isFrameRecording(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  char magic[4];
+  const RecordingHeader expected;
+  return in.read(magic, sizeof(magic)) &&
+         std::memcmp(magic, expected.magic, sizeof(magic)) == 0;
+}
+
+std::unique_ptr<FrameSource> openReplayInput(const std::string &input,
+                                             uint64_t frames, bool realtime,
+                                             cv::Size &frameSize) {
+  if (isFrameRecording(input)) {
+    std::unique_ptr<RecordedSource> recorded(
+        new RecordedSource(input, frames, realtime));
+    if (!recorded->isOpened())
+      return nullptr;
+    if (recorded->frameCount() == 0) {
+      std::cerr << input << " has no frames\n";
+      return nullptr;
+    }
+    frameSize = recorded->frameSize();
+    return recorded;
+  }
+  std::unique_ptr<ReplaySource> replay(new ReplaySource(input, frames));
+  if (!replay->isOpened()) {
+    std::cerr << "Cannot open " << input << "\n";
+    return nullptr;
+  }
+  frameSize = replay->frameSize();
+  return replay;
+}
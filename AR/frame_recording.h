@@ -0,0 +1,137 @@
+#pragma once
+
+#include "frame_source.h"
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+// Container for captured frames that can be replayed bit-exactly.
+//
+//   RecordingHeader | frame 0 | frame 1 | ... | RecordingIndexEntry[count]
+//
+// Frames are stored raw (no compression yet, `compression` is always 0),
+// row after row with no padding, each starting on a kRecordingAlignment
+// boundary so a view over the mapped file is as well aligned as a cv::Mat
+// allocation. The index goes last because the frame count is only known
+// when recording stops; the header is rewritten then.
+struct RecordingHeader {
+  char magic[4] = {'A', 'R', 'F', 'R'};
+  uint32_t version = 1;
+  uint32_t headerSize = sizeof(RecordingHeader);
+  int32_t width = 0, height = 0;
+  int32_t type = 0;     // OpenCV type of every frame, CV_8UC3 for BGR
+  uint32_t stride = 0;  // bytes per row
+  uint32_t compression = 0;
+  uint64_t frameCount = 0;
+  uint64_t indexOffset = 0;
+  uint64_t reserved[2] = {0, 0};
+};
+static_assert(sizeof(RecordingHeader) == 64, "RecordingHeader is on disk");
+
+struct RecordingIndexEntry {
+  uint64_t offset; // of the frame's first byte in the file
+  uint64_t size;
+  int64_t tCaptureNs; // since the first recorded frame
+  uint64_t sequence;  // as numbered by the recorded source
+  uint64_t dropped;   // frames that source dropped before this one
+};
+
+const size_t kRecordingAlignment = 64;
+
+// Writes frames to a recording. Each write() goes straight to the file, so
+// the recorded stream is lossless but the caller waits for the disk.
+class FrameRecorder {
+public:
+  explicit FrameRecorder(const std::string &path);
+  // Writes the index and the final header.
+  ~FrameRecorder();
+  FrameRecorder(const FrameRecorder &) = delete;
+  FrameRecorder &operator=(const FrameRecorder &) = delete;
+
+  bool isOpen() const { return isOpen_; }
+  uint64_t frames() const { return index_.size(); }
+
+  // Every frame must have the size and type of the first one; others are
+  // rejected (false).
+  bool write(const CapturedFrame &frame);
+
+private:
+  std::string path_;
+  std::ofstream out_;
+  bool isOpen_ = false;
+  RecordingHeader header_;
+  std::vector<RecordingIndexEntry> index_;
+  uint64_t offset_ = 0;
+  std::chrono::high_resolution_clock::time_point tFirst_;
+};
+
+// Passes the frames of another source through while recording them.
+class RecordingSource : public FrameSource {
+public:
+  RecordingSource(std::unique_ptr<FrameSource> inner, const std::string &path);
+
+  bool isOpen() const { return recorder_.isOpen(); }
+
+  bool read(CapturedFrame &out) override;
+  void close() override { inner_->close(); }
+  bool dropsStaleFrames() const override { return inner_->dropsStaleFrames(); }
+
+private:
+  std::unique_ptr<FrameSource> inner_;
+  FrameRecorder recorder_;
+};
+
+// Plays a recording back from a memory mapping. read() hands out cv::Mat
+// views straight into the mapping; nothing is copied or decoded. The frames
+// are marked borrowed and the mapping is read-only: a consumer that wrote
+// into one would otherwise get private copies of its pages, and resident
+// memory would grow to the size of the recording.
+class RecordedSource : public FrameSource {
+public:
+  // `frames` = 0 plays every frame once; more frames than recorded loop the
+  // recording. With `realtime` frames are released at their recorded pace
+  // instead of as fast as they are asked for.
+  RecordedSource(const std::string &path, uint64_t frames, bool realtime);
+  ~RecordedSource() override;
+  RecordedSource(const RecordedSource &) = delete;
+  RecordedSource &operator=(const RecordedSource &) = delete;
+
+  bool isOpened() const { return index_ != nullptr; }
+  cv::Size frameSize() const;
+  uint64_t frameCount() const { return header_.frameCount; }
+
+  bool read(CapturedFrame &out) override;
+  void close() override { closed_ = true; }
+
+private:
+  bool map(const std::string &path);
+  void unmap();
+
+  unsigned char *data_ = nullptr;
+  size_t size_ = 0;
+#ifdef _WIN32
+  void *file_ = nullptr, *mapping_ = nullptr;
+#endif
+  RecordingHeader header_;
+  const RecordingIndexEntry *index_ = nullptr;
+  uint64_t limit_;
+  bool realtime_;
+  uint64_t next_ = 0;
+  std::chrono::high_resolution_clock::time_point tStart_;
+  std::atomic<bool> closed_{false};
+};
+
+// True if `path` starts like a recording written by FrameRecorder.
+bool isFrameRecording(const std::string &path);
+
+// Opens `input` for replay: a recording, or anything ReplaySource plays
+// (`realtime` only applies to recordings). Returns null, after printing
+// why, if it cannot be opened.
+std::unique_ptr<FrameSource> openReplayInput(const std::string &input,
+                                             uint64_t frames, bool realtime,
+                                             cv::Size &frameSize);
@@ -0,0 +1,118 @@
+#include "frame_source.h"
+
+bool VideoCaptureSource::read(CapturedFrame &out) {
+  if (closed_)
+    return false;
+  // Decodes into the buffer the caller passed in when it has the right size
+  cap_ >> out.frame;
+  out.tCapture = std::chrono::high_resolution_clock::now();
+  if (out.frame.empty())
+    return false;
+  out.sequence = sequence_++;
+  out.dropped = 0;
+  return true;
+}
+
+ReplaySource::ReplaySource(const std::string &input, uint64_t frames)
+    : input_(input), limit_(frames) {
+  // A plain image file (no %d pattern) is not a sequence VideoCapture can
+  // open portably, so it is decoded once and repeated
+  if (input.find('%') == std::string::npos && cv::haveImageReader(input))
+    still_ = cv::imread(input, cv::IMREAD_COLOR);
+  if (still_.empty())
+    cap_.open(input);
+  if (limit_ == 0)
+    limit_ = still_.empty() ? UINT64_MAX : 1;
+}
+
+cv::Size ReplaySource::frameSize() const {
+  if (!still_.empty())
+    return still_.size();
+  return cv::Size(static_cast<int>(cap_.get(cv::CAP_PROP_FRAME_WIDTH)),
+                  static_cast<int>(cap_.get(cv::CAP_PROP_FRAME_HEIGHT)));
+}
+
+bool ReplaySource::read(CapturedFrame &out) {
+  if (closed_ || sequence_ >= limit_)
+    return false;
+  if (!still_.empty()) {
+    still_.copyTo(out.frame);
+  } else {
+    cap_ >> out.frame;
+    if (out.frame.empty() && limit_ != UINT64_MAX && sequence_ > 0) {
+      // Seeking is unreliable for image sequences; reopening always works
+      cap_.open(input_);
+      cap_ >> out.frame;
+    }
+  }
+  out.tCapture = std::chrono::high_resolution_clock::now();
+  if (out.frame.empty())
+    return false;
+  out.sequence = sequence_++;
+  out.dropped = 0;
+  return true;
+}
+
+LatestFrameCapture::LatestFrameCapture(cv::VideoCapture &cap) : cap_(cap) {
+  // Ask the backend to keep as few frames as possible; not every backend
+  // honours this, which is why the grab thread exists in the first place.
+  cap_.set(cv::CAP_PROP_BUFFERSIZE, 1);
+  grabThread_ = std::thread(&LatestFrameCapture::grabLoop, this);
+}
+
+LatestFrameCapture::~LatestFrameCapture() { close(); }
+
+void LatestFrameCapture::close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+  }
+  frameReady_.notify_all();
+  if (grabThread_.joinable())
+    grabThread_.join();
+}
+
+void LatestFrameCapture::grabLoop() {
+  uint64_t sequence = 0;
+  // Swapped with latest_.frame on publish, so this thread gets back either
+  // the stale frame it replaced or the buffer read() handed over; neither is
+  // referenced anywhere else.
+  cv::Mat frame;
+  while (running_) {
+    cap_ >> frame;
+    auto tCapture = std::chrono::high_resolution_clock::now();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (frame.empty()) {
+      endOfStream_ = true;
+      frameReady_.notify_all();
+      return;
+    }
+    if (fresh_) {
+      ++pendingDropped_;
+      ++totalDropped_;
+    }
+    std::swap(latest_.frame, frame);
+    latest_.sequence = sequence++;
+    latest_.tCapture = tCapture;
+    fresh_ = true;
+    frameReady_.notify_one();
+  }
+}
+
+bool LatestFrameCapture::read(CapturedFrame &out) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  frameReady_.wait(lock, [this] { return fresh_ || endOfStream_ || !running_; });
+  if (!running_ || !fresh_)
+    return false;
+
+  // Hand over the newest frame and keep the caller's (recycled) buffer for
+  // the grab thread to decode into
+  std::swap(out.frame, latest_.frame);
+  out.sequence = latest_.sequence;
+  out.tCapture = latest_.tCapture;
+  out.dropped = pendingDropped_;
+  pendingDropped_ = 0;
+  fresh_ = false;
+  return true;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <thread>
+
+// A frame as handed out by a FrameSource.
+struct CapturedFrame {
+  cv::Mat frame; // BGR
+  uint64_t sequence = 0;
+  std::chrono::high_resolution_clock::time_point tCapture;
+  // Frames the source discarded since the previous read() because the
+  // consumer was too slow to take them
+  uint64_t dropped = 0;
+  // `frame` is a view into memory the source owns (e.g. a file mapping) and
+  // must not be written to
+  bool borrowed = false;
+};
+
+// Where the pipeline gets its frames from.
+class FrameSource {
+public:
+  virtual ~FrameSource() = default;
+
+  // Blocks until the next frame is available. Returns false at the end of the
+  // stream or after close(). A buffer already in out.frame is not kept by
+  // the caller and may be decoded into (or kept) by the source.
+  virtual bool read(CapturedFrame &out) = 0;
+
+  // Unblocks a pending read(); later reads return false.
+  virtual void close() {}
+
+  // True if the source keeps only the newest frame, in which case the
+  // consumer should ask for a frame only when it can process it right away.
+  virtual bool dropsStaleFrames() const { return false; }
+};
+
+// Reads synchronously from a cv::VideoCapture, i.e. the plain `cap >> frame`.
+// Frames the consumer does not pick up in time pile up in the driver.
+class VideoCaptureSource : public FrameSource {
+public:
+  explicit VideoCaptureSource(cv::VideoCapture &cap) : cap_(cap) {}
+
+  bool read(CapturedFrame &out) override;
+  void close() override { closed_ = true; }
+
+private:
+  cv::VideoCapture &cap_;
+  uint64_t sequence_ = 0;
+  std::atomic<bool> closed_{false};
+};
+
+// Plays back a recording for the headless benchmark: a video file, an image
+// sequence (frames/%04d.png) or a single still image. Frames are decoded on
+// the capture thread, like a camera's, and handed out as fast as they are
+// asked for.
+class ReplaySource : public FrameSource {
+public:
+  // `frames` = 0 plays the input once; otherwise it is rewound as often as
+  // needed to deliver exactly that many frames.
+  ReplaySource(const std::string &input, uint64_t frames);
+
+  bool isOpened() const { return !still_.empty() || cap_.isOpened(); }
+  cv::Size frameSize() const;
+
+  bool read(CapturedFrame &out) override;
+  void close() override { closed_ = true; }
+
+private:
+  std::string input_;
+  cv::VideoCapture cap_;
+  cv::Mat still_; // decoded once when the input is a single image
+  uint64_t limit_;
+  uint64_t sequence_ = 0;
+  std::atomic<bool> closed_{false};
+};
+
+// Latest-frame-wins capture front-end.
+//
+// A dedicated thread keeps grabbing from the cv::VideoCapture so the driver
+// queue never fills up; each read() returns the newest frame and reports how
+// many older ones were overwritten before anyone asked for them.
+class LatestFrameCapture : public FrameSource {
+public:
+  explicit LatestFrameCapture(cv::VideoCapture &cap);
+  ~LatestFrameCapture() override;
+
+  bool read(CapturedFrame &out) override;
+  void close() override;
+  bool dropsStaleFrames() const override { return true; }
+
+  uint64_t totalDropped() const { return totalDropped_; }
+
+private:
+  void grabLoop();
+
+  cv::VideoCapture &cap_;
+
+  std::mutex mutex_;
+  std::condition_variable frameReady_;
+  CapturedFrame latest_;  // guarded by mutex_
+  bool fresh_ = false;    // latest_ not yet handed out
+  bool endOfStream_ = false;
+  uint64_t pendingDropped_ = 0;
+
+  std::atomic<uint64_t> totalDropped_{0};
+  std::atomic<bool> running_{true};
+  std::thread grabThread_;
+};
@@ -0,0 +1,98 @@
+#include "gpu_timer.h"
+
+GpuTimer::GpuTimer() {
+  for (Slot &slot : slots_)
+    glGenQueries(kMarkCount, slot.queries);
+  calibrate();
+}
+
+GpuTimer::~GpuTimer() {
+  for (Slot &slot : slots_) {
+    glDeleteQueries(kMarkCount, slot.queries);
+    if (slot.fence)
+      glDeleteSync(slot.fence);
+  }
+}
+
+// GPU and CPU clocks drift apart slowly, so the pair is refreshed now and
+// then. Reading GL_TIMESTAMP returns the current GPU time without waiting
+// for queued commands.
+void GpuTimer::calibrate() {
+  glGetInteger64v(GL_TIMESTAMP, &gpuRef_);
+  cpuRef_ = std::chrono::high_resolution_clock::now();
+  framesSinceCalibration_ = 0;
+}
+
+void GpuTimer::beginFrame(uint64_t frame) {
+  // The caller is expected to poll() first; if it did not, the oldest
+  // result is waited for and thrown away rather than overwritten in flight
+  GpuFrameTimes discarded;
+  if (full())
+    poll(discarded, true);
+  if (++framesSinceCalibration_ >= 300)
+    calibrate();
+
+  current_ = (head_ + count_) % kFramesInFlight;
+  Slot &slot = slots_[current_];
+  slot.frame = frame;
+  slot.gpuRef = gpuRef_;
+  slot.cpuRef = cpuRef_;
+  glQueryCounter(slot.queries[Begin], GL_TIMESTAMP);
+}
+
+void GpuTimer::markUpload() {
+  if (current_ >= 0)
+    glQueryCounter(slots_[current_].queries[Uploaded], GL_TIMESTAMP);
+}
+
+void GpuTimer::endFrame() {
+  if (current_ < 0)
+    return;
+  Slot &slot = slots_[current_];
+  glQueryCounter(slot.queries[End], GL_TIMESTAMP);
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  current_ = -1;
+  ++count_;
+}
+
+bool GpuTimer::poll(GpuFrameTimes &out, bool wait) {
+  if (count_ == 0)
+    return false;
+  Slot &slot = slots_[head_];
+
+  GLenum status = glClientWaitSync(slot.fence, 0, 0);
+  if (status == GL_TIMEOUT_EXPIRED) {
+    if (!wait)
+      return false;
+    ++stalls_;
+    // Flush so the fence is guaranteed to reach the GPU, then wait it out
+    do {
+      status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                1000000); // 1 ms
+    } while (status == GL_TIMEOUT_EXPIRED);
+  }
+  glDeleteSync(slot.fence);
+  slot.fence = nullptr;
+
+  // Everything before the fence has executed, so the results are available
+  GLuint64 stamps[kMarkCount];
+  for (int i = 0; i < kMarkCount; ++i)
+    glGetQueryObjectui64v(slot.queries[i], GL_QUERY_RESULT, &stamps[i]);
+
+  auto toCpu = [&slot](GLuint64 stamp) {
+    return slot.cpuRef +
+           std::chrono::duration_cast<
+               std::chrono::high_resolution_clock::duration>(
+               std::chrono::nanoseconds(
+                   static_cast<GLint64>(stamp) - slot.gpuRef));
+  };
+  out.frame = slot.frame;
+  out.uploadMs = (stamps[Uploaded] - stamps[Begin]) * 1e-6;
+  out.drawMs = (stamps[End] - stamps[Uploaded]) * 1e-6;
+  out.tUploaded = toCpu(stamps[Uploaded]);
+  out.tDone = toCpu(stamps[End]);
+
+  head_ = (head_ + 1) % kFramesInFlight;
+  --count_;
+  return true;
+}
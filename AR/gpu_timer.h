@@ -0,0 +1,74 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cstdint>
+
+// GPU-side timings of one rendered frame.
+struct GpuFrameTimes {
+  uint64_t frame = 0; // id passed to GpuTimer::beginFrame()
+  // Texture upload and everything drawn after it, measured on the GPU
+  double uploadMs = 0.0;
+  double drawMs = 0.0;
+  // When the GPU finished the upload and the whole frame, converted to the
+  // CPU clock
+  std::chrono::high_resolution_clock::time_point tUploaded, tDone;
+};
+
+// Non-blocking GPU frame timing.
+//
+// Each frame drops three GL_TIMESTAMP queries (begin, after the upload, end)
+// and a fence into the command stream. The results are read back once the
+// fence has signalled, typically a couple of frames later, so measuring never
+// waits for the GPU the way glFinish() did. Up to kFramesInFlight frames can
+// be outstanding; when all slots are busy the caller has to wait for the
+// oldest one (poll() with wait = true).
+//
+// Needs a current GL 3.3 context for its whole lifetime.
+class GpuTimer {
+public:
+  static const int kFramesInFlight = 4;
+
+  GpuTimer();
+  ~GpuTimer();
+  GpuTimer(const GpuTimer &) = delete;
+  GpuTimer &operator=(const GpuTimer &) = delete;
+
+  void beginFrame(uint64_t frame);
+  void markUpload();
+  void endFrame();
+
+  // Hands back the oldest submitted frame once the GPU is done with it.
+  // With `wait` it blocks until then; returns false if nothing is pending or,
+  // without `wait`, the oldest frame is still in flight.
+  bool poll(GpuFrameTimes &out, bool wait = false);
+
+  bool full() const { return count_ == kFramesInFlight; }
+  // Number of polls that had to block for the GPU
+  uint64_t stalls() const { return stalls_; }
+
+private:
+  enum Mark { Begin, Uploaded, End, kMarkCount };
+
+  struct Slot {
+    GLuint queries[kMarkCount] = {};
+    GLsync fence = nullptr;
+    uint64_t frame = 0;
+    // GPU and CPU clock read at the same moment, for converting timestamps
+    GLint64 gpuRef = 0;
+    std::chrono::high_resolution_clock::time_point cpuRef;
+  };
+
+  void calibrate();
+
+  Slot slots_[kFramesInFlight];
+  int head_ = 0;  // oldest submitted frame
+  int count_ = 0; // frames submitted but not polled yet
+  int current_ = -1;
+  uint64_t stalls_ = 0;
+
+  GLint64 gpuRef_ = 0;
+  std::chrono::high_resolution_clock::time_point cpuRef_;
+  uint64_t framesSinceCalibration_ = 0;
+};
@@ -0,0 +1,95 @@
+#include "latency_controller.h"
+
+#include <iomanip>
+
+namespace {
+const int kFastFlags = cv::CALIB_CB_FAST_CHECK;
+const int kAdaptiveFlags = cv::CALIB_CB_ADAPTIVE_THRESH | kFastFlags;
+const int kAllFlags = cv::CALIB_CB_NORMALIZE_IMAGE | kAdaptiveFlags;
+
+// Best quality first. Each rung gives up a little accuracy or robustness
+// for a cheaper typical frame.
+const QualityLevel kLadder[] = {
+    {"full", 0, 0.5f, kAllFlags, 11, 30, false, 10},
+    {"auto-pyramid", -1, 0.35f, kAllFlags, 11, 20, false, 10},
+    {"tracking", -1, 0.25f, kAllFlags, 7, 15, true, 10},
+    {"lean", -1, 0.2f, kAdaptiveFlags, 5, 10, true, 20},
+    {"minimal", kMaxPyramidLevel, 0.15f, kFastFlags, 5, 5, true, 30},
+};
+const int kLevels = sizeof(kLadder) / sizeof(kLadder[0]);
+
+// Frames to wait after a change before judging the new settings
+const int kCooldownFrames = 30;
+// Consecutive frames the average has to be over budget before stepping
+// down, and comfortably under it before stepping up
+const int kOverFrames = 5;
+const int kUnderFrames = 60;
+const double kUnderFraction = 0.6;
+const double kAlpha = 0.1;
+} // namespace
+
+LatencyController::LatencyController(double budgetMs, std::ostream &log)
+    : budgetMs_(budgetMs), log_(log) {}
+
+int LatencyController::levelCount() { return kLevels; }
+
+const QualityLevel &LatencyController::quality() const {
+  return kLadder[level_];
+}
+
+void LatencyController::apply(int level, DetectorSettings &settings) {
+  const QualityLevel &q = kLadder[level];
+  settings.pyramidLevel = q.pyramidLevel;
+  settings.roiMargin = q.roiMargin;
+  settings.chessboardFlags = q.chessboardFlags;
+  settings.subPixWindow = q.subPixWindow;
+  settings.subPixIterations = q.subPixIterations;
+  settings.tracking = q.tracking;
+  settings.redetectInterval = q.redetectInterval;
+}
+
+bool LatencyController::update(uint64_t frame,
+                               const BoardDetection &detection,
+                               DetectorSettings &settings) {
+  // The knobs make no difference to a frame the motion gate skipped, and
+  // its gate-only cost would pull the average towards zero
+  if (detection.gated)
+    return false;
+  const double ms = detection.detectMs + detection.poseMs + detection.reprojMs;
+  averageMs_ = samples_++ == 0 ? ms : averageMs_ + kAlpha * (ms - averageMs_);
+  if (++sinceChange_ < kCooldownFrames)
+    return false;
+
+  framesOver_ = averageMs_ > budgetMs_ ? framesOver_ + 1 : 0;
+  framesUnder_ =
+      averageMs_ < kUnderFraction * budgetMs_ ? framesUnder_ + 1 : 0;
+  int next = level_;
+  if (framesOver_ >= kOverFrames && level_ + 1 < kLevels)
+    ++next;
+  else if (framesUnder_ >= kUnderFrames && level_ > 0)
+    --next;
+  if (next == level_)
+    return false;
+
+  const QualityLevel &q = kLadder[next];
+  log_ << "latency budget: frame " << frame << ", detection " << std::fixed
+       << std::setprecision(2) << averageMs_ << " ms avg vs " << budgetMs_
+       << " ms, quality " << kLadder[level_].name << " -> " << q.name
+       << " (pyramid " << q.pyramidLevel << ", roi margin " << q.roiMargin
+       << ", flags 0x" << std::hex << q.chessboardFlags << std::dec
+       << ", subpix " << q.subPixWindow << "/" << q.subPixIterations
+       << ", tracking ";
+  if (q.tracking)
+    log_ << "every " << q.redetectInterval;
+  else
+    log_ << "off";
+  log_ << ")\n";
+  log_.unsetf(std::ios::floatfield);
+
+  level_ = next;
+  apply(level_, settings);
+  sinceChange_ = 0;
+  framesOver_ = framesUnder_ = 0;
+  ++changes_;
+  return true;
+}
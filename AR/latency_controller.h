@@ -0,0 +1,61 @@
+#pragma once
+
+#include "board_detector.h"
+
+#include <cstdint>
+#include <ostream>
+
+// One rung of the detection quality ladder: the knobs the controller owns.
+struct QualityLevel {
+  const char *name;
+  int pyramidLevel;
+  float roiMargin;
+  int chessboardFlags;
+  int subPixWindow;
+  int subPixIterations;
+  bool tracking;
+  int redetectInterval;
+};
+
+// Holds the detection stage inside a per-frame time budget.
+//
+// Every frame detection ran on feeds its corner search + pose + reprojection
+// time into an exponential moving average. When the average stays above the
+// budget the controller moves one rung down a fixed quality ladder (coarser
+// pyramid, tighter ROI, cheaper chessboard flags, smaller cornerSubPix
+// window, more tracking between full detections); when it stays well below,
+// it moves back up. A cool-down after every change lets the new settings
+// show in the average before the next decision. Every change is written to
+// the log stream.
+//
+// Only the knobs in QualityLevel are touched; the pose solver, motion gate
+// and the rest of DetectorSettings stay as the user set them.
+class LatencyController {
+public:
+  LatencyController(double budgetMs, std::ostream &log);
+
+  // Feeds one frame from the detection stage. Returns true, after updating
+  // the controlled fields of `settings`, if the quality level changed.
+  bool update(uint64_t frame, const BoardDetection &detection,
+              DetectorSettings &settings);
+
+  double budgetMs() const { return budgetMs_; }
+  void setBudgetMs(double budgetMs) { budgetMs_ = budgetMs; }
+  int level() const { return level_; }
+  const QualityLevel &quality() const;
+  double averageMs() const { return averageMs_; }
+  uint64_t changes() const { return changes_; }
+
+  static int levelCount();
+  static void apply(int level, DetectorSettings &settings);
+
+private:
+  double budgetMs_;
+  std::ostream &log_;
+  int level_ = 0;
+  double averageMs_ = 0.0;
+  uint64_t samples_ = 0;
+  int sinceChange_ = 0;
+  int framesOver_ = 0, framesUnder_ = 0;
+  uint64_t changes_ = 0;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <opencv2/opencv.hpp>
+#include <string>
+
+// Framebuffer object the AR view renders into instead of the window, for
+// runs without a display (EGL surfaceless or OSMesa contexts, see --offscreen
+// in AR.cpp). Colour is a plain RGBA8 renderbuffer, depth a 24-bit one; no
+// multisampling, so a frame looks the same on every driver.
+//
+// Needs a current GL 3.3 context for its whole lifetime.
+class OffscreenTarget {
+public:
+  OffscreenTarget(int width, int height);
+  ~OffscreenTarget();
+  OffscreenTarget(const OffscreenTarget &) = delete;
+  OffscreenTarget &operator=(const OffscreenTarget &) = delete;
+
+  // False if the driver rejected the attachment combination.
+  bool complete() const { return complete_; }
+  int width() const { return width_; }
+  int height() const { return height_; }
+
+  // Makes it the draw and read framebuffer and sets the viewport.
+  void bind() const;
+
+  // Reads back what has been drawn so far as a top-down BGR image. Waits
+  // for the GPU, so only meant for the frames being checked.
+  void read(cv::Mat &bgr);
+
+private:
+  int width_, height_;
+  GLuint framebuffer_ = 0;
+  GLuint color_ = 0, depth_ = 0;
+  bool complete_ = false;
+  cv::Mat bgra_; // glReadPixels target, bottom-up
+};
+
+// Peak signal-to-noise ratio of `frame` against the image stored at `path`,
+// in dB. Returns 0 if the file is missing or its size differs.
+double goldenPsnr(const cv::Mat &frame, const std::string &path);
@@ -0,0 +1,193 @@
+#include "pose_estimator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+
+const char *poseMethodName(PoseMethod method) {
+  switch (method) {
+  case PoseMethod::Ippe:
+    return "ippe";
+  case PoseMethod::Homography:
+    return "homography";
+  case PoseMethod::Refine:
+    return "refine";
+  default:
+    return "iterative";
+  }
+}
+
+bool parsePoseMethod(const std::string &name, PoseMethod &method) {
+  for (int i = 0; i < kPoseMethodCount; ++i) {
+    if (name == poseMethodName(static_cast<PoseMethod>(i))) {
+      method = static_cast<PoseMethod>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+PoseEstimator::PoseEstimator(const std::vector<cv::Point3f> &objectPoints,
+                             const cv::Mat &cameraMatrix,
+                             const cv::Mat &distCoeffs)
+    : objectPoints_(objectPoints), cameraMatrix_(cameraMatrix.clone()),
+      distCoeffs_(distCoeffs.clone()) {
+  for (const cv::Point3f &p : objectPoints_)
+    boardPoints_.push_back(cv::Point2f(p.x, p.y));
+}
+
+void PoseEstimator::estimate(const std::vector<cv::Point2f> &corners,
+                             PoseMethod method, bool warmStart, cv::Mat &rvec,
+                             cv::Mat &tvec) {
+  const bool guess = warmStart && hasPrevious_;
+  switch (method) {
+  case PoseMethod::Iterative:
+    if (guess) {
+      prevRvec_.copyTo(rvec);
+      prevTvec_.copyTo(tvec);
+    }
+    cv::solvePnP(objectPoints_, corners, cameraMatrix_, distCoeffs_, rvec,
+                 tvec, guess, cv::SOLVEPNP_ITERATIVE);
+    break;
+  case PoseMethod::Ippe:
+    cv::solvePnP(objectPoints_, corners, cameraMatrix_, distCoeffs_, rvec,
+                 tvec, false, cv::SOLVEPNP_IPPE);
+    break;
+  case PoseMethod::Homography:
+    solveHomography(corners, rvec, tvec);
+    break;
+  case PoseMethod::Refine:
+    if (guess) {
+      prevRvec_.copyTo(rvec);
+      prevTvec_.copyTo(tvec);
+      cv::solvePnPRefineLM(objectPoints_, corners, cameraMatrix_, distCoeffs_,
+                           rvec, tvec);
+    } else {
+      // Nothing to refine yet: seed with the closed-form planar solution
+      cv::solvePnP(objectPoints_, corners, cameraMatrix_, distCoeffs_, rvec,
+                   tvec, false, cv::SOLVEPNP_IPPE);
+    }
+    break;
+  }
+  rvec.copyTo(prevRvec_);
+  tvec.copyTo(prevTvec_);
+  hasPrevious_ = true;
+}
+
+void PoseEstimator::restore(const cv::Mat &rvec, const cv::Mat &tvec) {
+  rvec.copyTo(prevRvec_);
+  tvec.copyTo(prevTvec_);
+  hasPrevious_ = !rvec.empty() && !tvec.empty();
+}
+
+// Zhang's decomposition: in normalized image coordinates the board-to-image
+// homography is lambda * [r1 r2 t].
+void PoseEstimator::solveHomography(const std::vector<cv::Point2f> &corners,
+                                    cv::Mat &rvec, cv::Mat &tvec) {
+  cv::undistortPoints(corners, normalized_, cameraMatrix_, distCoeffs_);
+  cv::Mat H = cv::findHomography(boardPoints_, normalized_);
+  if (H.empty()) {
+    cv::solvePnP(objectPoints_, corners, cameraMatrix_, distCoeffs_, rvec,
+                 tvec, false, cv::SOLVEPNP_IPPE);
+    return;
+  }
+
+  cv::Mat h1 = H.col(0), h2 = H.col(1), h3 = H.col(2);
+  double lambda = 2.0 / (cv::norm(h1) + cv::norm(h2));
+  // The board has to be in front of the camera (t_z > 0)
+  if (H.at<double>(2, 2) < 0)
+    lambda = -lambda;
+
+  cv::Mat r1 = h1 * lambda, r2 = h2 * lambda;
+  cv::Mat r3 = r1.cross(r2);
+  cv::Mat R;
+  cv::hconcat(std::vector<cv::Mat>{r1, r2, r3}, R);
+  // Noise makes R only approximately orthonormal; use the closest rotation
+  cv::SVD svd(R);
+  R = svd.u * svd.vt;
+
+  cv::Rodrigues(R, rvec);
+  tvec = h3 * lambda;
+}
+
+namespace {
+double meanReprojectionError(const std::vector<cv::Point3f> &objectPoints,
+                             const std::vector<cv::Point2f> &corners,
+                             const cv::Mat &rvec, const cv::Mat &tvec,
+                             const cv::Mat &cameraMatrix,
+                             const cv::Mat &distCoeffs) {
+  std::vector<cv::Point2f> projected;
+  cv::projectPoints(objectPoints, rvec, tvec, cameraMatrix, distCoeffs,
+                    projected);
+  double sum = 0.0;
+  for (size_t i = 0; i < projected.size(); ++i) {
+    double dx = projected[i].x - corners[i].x;
+    double dy = projected[i].y - corners[i].y;
+    sum += std::sqrt(dx * dx + dy * dy);
+  }
+  return projected.empty() ? 0.0 : sum / projected.size();
+}
+
+double percentile(std::vector<double> values, double p) {
+  if (values.empty())
+    return 0.0;
+  size_t k = static_cast<size_t>(p * (values.size() - 1));
+  std::nth_element(values.begin(), values.begin() + k, values.end());
+  return values[k];
+}
+} // namespace
+
+void benchmarkPoseMethods(
+    const std::vector<std::vector<cv::Point2f>> &cornerSets,
+    const std::vector<cv::Point3f> &objectPoints, const cv::Mat &cameraMatrix,
+    const cv::Mat &distCoeffs, std::ostream &os) {
+  // Each configuration runs over the sequence a few times so the timings are
+  // not dominated by cold caches; the estimator is reset between passes.
+  const int passes = 5;
+
+  os << std::left << std::setw(12) << "method" << std::setw(7) << "warm"
+     << std::right << std::setw(10) << "mean_us" << std::setw(10) << "p50_us"
+     << std::setw(10) << "p99_us" << std::setw(14) << "reproj_mean"
+     << "\n";
+  for (int m = 0; m < kPoseMethodCount; ++m) {
+    const PoseMethod method = static_cast<PoseMethod>(m);
+    for (int warm = 0; warm < 2; ++warm) {
+      // Only the iterative and refine paths use the previous pose
+      if (warm && method != PoseMethod::Iterative &&
+          method != PoseMethod::Refine)
+        continue;
+
+      std::vector<double> timesUs;
+      timesUs.reserve(cornerSets.size() * passes);
+      double reprojSum = 0.0;
+      for (int pass = 0; pass < passes; ++pass) {
+        PoseEstimator estimator(objectPoints, cameraMatrix, distCoeffs);
+        for (const std::vector<cv::Point2f> &corners : cornerSets) {
+          cv::Mat rvec, tvec;
+          auto t0 = std::chrono::high_resolution_clock::now();
+          estimator.estimate(corners, method, warm != 0, rvec, tvec);
+          auto t1 = std::chrono::high_resolution_clock::now();
+          timesUs.push_back(
+              std::chrono::duration<double, std::micro>(t1 - t0).count());
+          if (pass == 0)
+            reprojSum += meanReprojectionError(objectPoints, corners, rvec,
+                                               tvec, cameraMatrix, distCoeffs);
+        }
+      }
+
+      double mean = 0.0;
+      for (double t : timesUs)
+        mean += t;
+      mean = timesUs.empty() ? 0.0 : mean / timesUs.size();
+      os << std::left << std::setw(12) << poseMethodName(method)
+         << std::setw(7) << (warm ? "yes" : "no") << std::right << std::fixed
+         << std::setprecision(1) << std::setw(10) << mean << std::setw(10)
+         << percentile(timesUs, 0.5) << std::setw(10)
+         << percentile(timesUs, 0.99) << std::setprecision(4)
+         << std::setw(14)
+         << (cornerSets.empty() ? 0.0 : reprojSum / cornerSets.size())
+         << "\n";
+    }
+  }
+}
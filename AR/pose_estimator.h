@@ -0,0 +1,57 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Ways to turn the 54 board corners into a camera pose.
+enum class PoseMethod {
+  Iterative,  // solvePnP SOLVEPNP_ITERATIVE (Levenberg-Marquardt)
+  Ippe,       // solvePnP SOLVEPNP_IPPE, closed form for planar targets
+  Homography, // board-to-image homography decomposed into [R|t]
+  Refine,     // solvePnPRefineLM from the previous pose only
+};
+
+const int kPoseMethodCount = 4;
+
+const char *poseMethodName(PoseMethod method);
+// Parses the names returned by poseMethodName(). Returns false if unknown.
+bool parsePoseMethod(const std::string &name, PoseMethod &method);
+
+// Planar board pose estimation with optional warm start.
+//
+// Remembers the last pose it returned so that the next call can start from
+// it: Iterative uses it as the extrinsic guess and Refine only polishes it.
+// Call reset() when the board is lost so a stale pose is not used as a seed,
+// or restore() to put back a pose that was accepted earlier.
+class PoseEstimator {
+public:
+  PoseEstimator(const std::vector<cv::Point3f> &objectPoints,
+                const cv::Mat &cameraMatrix, const cv::Mat &distCoeffs);
+
+  void estimate(const std::vector<cv::Point2f> &corners, PoseMethod method,
+                bool warmStart, cv::Mat &rvec, cv::Mat &tvec);
+  void reset() { hasPrevious_ = false; }
+  void restore(const cv::Mat &rvec, const cv::Mat &tvec);
+
+private:
+  void solveHomography(const std::vector<cv::Point2f> &corners, cv::Mat &rvec,
+                       cv::Mat &tvec);
+
+  std::vector<cv::Point3f> objectPoints_;
+  std::vector<cv::Point2f> boardPoints_; // objectPoints_ without z
+  cv::Mat cameraMatrix_, distCoeffs_;
+  std::vector<cv::Point2f> normalized_;
+
+  bool hasPrevious_ = false;
+  cv::Mat prevRvec_, prevTvec_;
+};
+
+// Runs every pose method (cold and, where it applies, warm-started) over the
+// same sequence of detected corner sets and prints latency and reprojection
+// error per method.
+void benchmarkPoseMethods(
+    const std::vector<std::vector<cv::Point2f>> &cornerSets,
+    const std::vector<cv::Point3f> &objectPoints, const cv::Mat &cameraMatrix,
+    const cv::Mat &distCoeffs, std::ostream &os);
@@ -0,0 +1,132 @@
+#include "replay_benchmark.h"
+
+#include "frame_pipeline.h"
+#include "frame_recording.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace {
+double percentile(std::vector<double> &values, double p) {
+  if (values.empty())
+    return 0.0;
+  size_t k = static_cast<size_t>(p * (values.size() - 1));
+  std::nth_element(values.begin(), values.begin() + k, values.end());
+  return values[k];
+}
+
+// Per-frame samples of one stage. Optional stages (pose, sub-pixel
+// refinement, ...) only contribute the frames they actually ran on.
+struct StageSamples {
+  const char *name;
+  std::vector<double> ms;
+};
+
+void printStage(StageSamples &stage, std::ostream &os) {
+  double mean = 0.0, max = 0.0;
+  for (double ms : stage.ms) {
+    mean += ms;
+    max = std::max(max, ms);
+  }
+  mean = stage.ms.empty() ? 0.0 : mean / stage.ms.size();
+  os << std::left << std::setw(12) << stage.name << std::right
+     << std::setw(8) << stage.ms.size() << std::fixed << std::setprecision(3)
+     << std::setw(10) << mean << std::setw(10) << percentile(stage.ms, 0.5)
+     << std::setw(10) << percentile(stage.ms, 0.9) << std::setw(10)
+     << percentile(stage.ms, 0.99) << std::setw(10) << max << "\n";
+}
+} // namespace
+
+int runReplayBenchmark(const std::string &input, uint64_t frames,
+                       size_t queueDepth, const DetectorSettings &settings,
+                       const CameraIntrinsics &intrinsics, std::ostream &os) {
+  cv::Size frameSize;
+  std::unique_ptr<FrameSource> source =
+      openReplayInput(input, frames, false, frameSize);
+  if (!source)
+    return -1;
+
+  const CameraIntrinsics camera = scaleIntrinsics(intrinsics, frameSize);
+  BoardDetector detector(cv::Size(9, 6), 0.025f, camera.cameraMatrix,
+                         camera.distCoeffs);
+  detector.setSettings(settings);
+  // No GL consumer: the frame stays BGR and only the sampled conversion runs
+  FramePipeline pipeline(*source, detector, queueDepth, false);
+
+  enum { kRead, kDetect, kGray, kSubPix, kPose, kReproj, kLatency, kStages };
+  StageSamples stages[kStages] = {
+      {"read", {}},   {"detect", {}}, {"gray", {}},    {"subpix", {}},
+      {"pose", {}},   {"reproj", {}}, {"latency", {}},
+  };
+  // --replay-frames is user input; past this the vectors simply grow
+  const size_t kMaxReserve = 1 << 16;
+  for (StageSamples &stage : stages)
+    stage.ms.reserve(frames ? std::min<uint64_t>(frames, kMaxReserve) : 4096);
+  uint64_t processed = 0, found = 0;
+  uint64_t modeCounts[kDetectModeCount] = {}; // indexed by DetectMode
+
+  auto t_start = PipelineClock::now();
+  pipeline.start();
+  FramePacket packet;
+  for (;;) {
+    if (!pipeline.tryPop(packet)) {
+      if (pipeline.finished())
+        break;
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+      continue;
+    }
+    const BoardDetection &d = packet.detection;
+    ++processed;
+    found += d.found ? 1 : 0;
+    ++modeCounts[static_cast<int>(d.mode)];
+
+    stages[kRead].ms.push_back(packet.readMs);
+    stages[kDetect].ms.push_back(d.detectMs);
+    if (d.grayMs > 0.0)
+      stages[kGray].ms.push_back(d.grayMs);
+    if (d.subPixMs > 0.0)
+      stages[kSubPix].ms.push_back(d.subPixMs);
+    // Static frames reuse the previous pose without solving
+    if (d.found && d.mode != DetectMode::Static) {
+      stages[kPose].ms.push_back(d.poseMs);
+      stages[kReproj].ms.push_back(d.reprojMs);
+    }
+    // Capture timestamp to the result being available to the consumer
+    stages[kLatency].ms.push_back(
+        std::chrono::duration<double, std::milli>(PipelineClock::now() -
+                                                  packet.tCapture)
+            .count());
+  }
+  const double seconds =
+      std::chrono::duration<double>(PipelineClock::now() - t_start).count();
+  pipeline.stop();
+
+  if (processed == 0) {
+    std::cerr << "No frames in " << input << "\n";
+    return -1;
+  }
+
+  os << "Replayed " << processed << " frames of " << input << " in "
+     << std::fixed << std::setprecision(3) << seconds << " s: "
+     << std::setprecision(1) << processed / seconds << " frames/s\n"
+     << "Board found in " << found << " frames ("
+     << 100.0 * found / processed << "%), full "
+     << modeCounts[static_cast<int>(DetectMode::Full)] << ", roi "
+     << modeCounts[static_cast<int>(DetectMode::Roi)] << ", track "
+     << modeCounts[static_cast<int>(DetectMode::Track)] << ", static "
+     << modeCounts[static_cast<int>(DetectMode::Static)] << "\n";
+  os << std::left << std::setw(12) << "stage" << std::right << std::setw(8)
+     << "frames" << std::setw(10) << "mean_ms" << std::setw(10) << "p50_ms"
+     << std::setw(10) << "p90_ms" << std::setw(10) << "p99_ms"
+     << std::setw(10) << "max_ms"
+     << "\n";
+  for (StageSamples &stage : stages)
+    printStage(stage, os);
+  os.unsetf(std::ios::floatfield);
+  detector.printReport(os);
+  return 0;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "board_detector.h"
+#include "camera_intrinsics.h"
+
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include <ostream>
+#include <string>
+
+// Runs the capture -> detection -> pose pipeline over a recording without a
+// window or GL context, as fast as the stages allow, and prints throughput,
+// detection rate and per-stage latency percentiles. `input` is a frame
+// recording or anything ReplaySource plays; `frames` = 0 plays it once.
+// `intrinsics` are scaled to the resolution of the input.
+// Returns the process exit code: non-zero if the input cannot be opened or
+// has no frames.
+int runReplayBenchmark(const std::string &input, uint64_t frames,
+                       size_t queueDepth, const DetectorSettings &settings,
+                       const CameraIntrinsics &intrinsics, std::ostream &os);
@@ -2,7 +2,10 @@
 out vec4 FragColor;
 in vec2 TexCoord;
 uniform sampler2D frameTex;
+// Set when the texture holds BGR data (raw camera order)
+uniform bool swapRB;
 void main()
 {
-    FragColor = texture(frameTex, TexCoord);
+    vec4 color = texture(frameTex, TexCoord);
+    FragColor = swapRB ? color.bgra : color;
 }
@@ -2,8 +2,10 @@
 layout(location = 0) in vec2 aPos;
 layout(location = 1) in vec2 aTexCoord;
 out vec2 TexCoord;
+// Set when the texture holds the frame top row first (raw camera order)
+uniform bool flipY;
 void main()
 {
     gl_Position = vec4(aPos.xy, 0.0, 1.0);
-    TexCoord = aTexCoord;
+    TexCoord = vec2(aTexCoord.x, flipY ? 1.0 - aTexCoord.y : aTexCoord.y);
 }
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Bounded single-producer / single-consumer ring buffer.
+//
+// Exactly one thread may call tryPush() and exactly one (other) thread may
+// call tryPop(). Neither call blocks or takes a lock; a full or empty queue is
+// reported through the return value so each stage can decide whether to wait,
+// drop or do something else. All slots are allocated up front.
+template <typename T> class SpscQueue {
+public:
+  explicit SpscQueue(size_t capacity) : slots_(capacity + 1) {}
+
+  SpscQueue(const SpscQueue &) = delete;
+  SpscQueue &operator=(const SpscQueue &) = delete;
+
+  // Producer side. Returns false (and leaves `item` untouched) when full.
+  bool tryPush(T &&item) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    const size_t next = increment(tail);
+    if (next == head_.load(std::memory_order_acquire))
+      return false;
+    slots_[tail] = std::move(item);
+    tail_.store(next, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Returns false when there is nothing to pop.
+  bool tryPop(T &out) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire))
+      return false;
+    out = std::move(slots_[head]);
+    head_.store(increment(head), std::memory_order_release);
+    return true;
+  }
+
+  // Approximate number of queued items; exact only when called from one of
+  // the two owning threads while the other is idle.
+  size_t size() const {
+    const size_t head = head_.load(std::memory_order_acquire);
+    const size_t tail = tail_.load(std::memory_order_acquire);
+    return tail >= head ? tail - head : slots_.size() - head + tail;
+  }
+
+  size_t capacity() const { return slots_.size() - 1; }
+  bool empty() const { return size() == 0; }
+
+private:
+  size_t increment(size_t i) const { return i + 1 == slots_.size() ? 0 : i + 1; }
+
+  // Keep the indices on separate cache lines so producer and consumer do not
+  // false-share.
+  alignas(64) std::atomic<size_t> head_{0};
+  alignas(64) std::atomic<size_t> tail_{0};
+  std::vector<T> slots_;
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Running timing of one processing step. Written by the thread doing the
+// work, read by the GUI/log on the render thread.
+struct StageStats {
+  std::atomic<double> lastMs{0.0};
+  std::atomic<double> avgMs{0.0};
+  std::atomic<uint64_t> frames{0};
+  // Number of times the stage had to wait because the next queue was full
+  std::atomic<uint64_t> stalls{0};
+  // Heap allocations (operator new) the stage's thread made for its last
+  // frame; see alloc_counter.h
+  std::atomic<uint64_t> allocations{0};
+
+  void record(double ms) {
+    lastMs.store(ms, std::memory_order_relaxed);
+    const uint64_t n = frames.fetch_add(1, std::memory_order_relaxed) + 1;
+    const double avg = avgMs.load(std::memory_order_relaxed);
+    // Plain mean for the first frames, then an exponential moving average
+    const double alpha = n < 20 ? 1.0 / n : 0.05;
+    avgMs.store(avg + alpha * (ms - avg), std::memory_order_relaxed);
+  }
+};
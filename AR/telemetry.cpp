@@ -0,0 +1,123 @@
+#include "telemetry.h"
+
+#include "board_detector.h"
+
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+TelemetryWriter::TelemetryWriter(const std::string &path, size_t capacity)
+    : out_(path, std::ios::binary), queue_(capacity) {
+  isOpen_ = out_.is_open();
+  if (!isOpen_) {
+    std::cerr << "Failed to open telemetry file: " << path << "\n";
+    return;
+  }
+  TelemetryHeader header;
+  out_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  running_ = true;
+  thread_ = std::thread(&TelemetryWriter::writeLoop, this);
+}
+
+TelemetryWriter::~TelemetryWriter() {
+  running_ = false;
+  if (thread_.joinable())
+    thread_.join();
+}
+
+bool TelemetryWriter::push(const TelemetryRecord &record) {
+  TelemetryRecord copy = record;
+  if (!isOpen_ || !queue_.tryPush(std::move(copy))) {
+    ++dropped_;
+    return false;
+  }
+  return true;
+}
+
+void TelemetryWriter::writeLoop() {
+  const auto flushInterval = std::chrono::seconds(1);
+  auto lastFlush = std::chrono::steady_clock::now();
+  TelemetryRecord record;
+  for (;;) {
+    // Read the flag before draining so nothing pushed before stop is lost
+    const bool stopping = !running_;
+    bool wrote = false;
+    while (queue_.tryPop(record)) {
+      out_.write(reinterpret_cast<const char *>(&record), sizeof(record));
+      ++written_;
+      wrote = true;
+    }
+    if (stopping)
+      break;
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now - lastFlush >= flushInterval) {
+      out_.flush();
+      lastFlush = now;
+    }
+    if (!wrote)
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  out_.flush();
+}
+
+void writeTelemetryCsvHeader(std::ostream &os) {
+  os << "frame,cap_ms,pnp_ms,upload_ms,swap_ms,found,t_x,t_y,t_z,r_x,r_y,r_"
+        "z,reproj_mean,reproj_median,reproj_max,cap_queue,result_queue,"
+        "dropped,detect_mode,detect_ms,pyr_level,pose_ms,"
+        "gpu_upload_ms,gpu_draw_ms,gpu_done_ms,upload_cpu_ms,"
+        "pbo_in_flight,convert_ms,convert_saved_ms,gray_ms,subpix_ms,"
+        "reproj_ms,imgui_ms,draw_cpu_ms,quality_level\n";
+}
+
+void writeTelemetryCsvRow(std::ostream &os, const TelemetryRecord &r) {
+  os << r.frame << "," << std::fixed << std::setprecision(3) << r.capMs
+     << "," << r.pnpMs << "," << r.uploadMs << "," << r.swapMs << ","
+     << int(r.found) << "," << r.t[0] << "," << r.t[1] << "," << r.t[2]
+     << "," << r.r[0] << "," << r.r[1] << "," << r.r[2] << ","
+     << r.reprojMean << "," << r.reprojMedian << "," << r.reprojMax << ","
+     << r.captureQueue << "," << r.resultQueue << "," << r.dropped << ","
+     << detectModeName(static_cast<DetectMode>(r.detectMode)) << ","
+     << r.detectMs << "," << int(r.pyramidLevel) << "," << r.poseMs << ","
+     << r.gpuUploadMs << "," << r.gpuDrawMs << "," << r.gpuDoneMs << ","
+     << r.uploadCpuMs << "," << r.pboInFlight << "," << r.convertMs << ","
+     << r.convertSavedMs << "," << r.grayMs << "," << r.subPixMs << ","
+     << r.reprojMs << "," << r.imguiMs << "," << r.drawCpuMs << ","
+     << int(r.qualityLevel) << "\n";
+}
+
+bool convertTelemetryToCsv(const std::string &binPath,
+                           const std::string &csvPath) {
+  std::ifstream in(binPath, std::ios::binary);
+  if (!in.is_open()) {
+    std::cerr << "Failed to open telemetry file: " << binPath << "\n";
+    return false;
+  }
+  TelemetryHeader expected, header;
+  in.read(reinterpret_cast<char *>(&header), sizeof(header));
+  if (!in || std::memcmp(header.magic, expected.magic, 4) != 0) {
+    std::cerr << binPath << " is not a telemetry file\n";
+    return false;
+  }
+  if (header.version != expected.version ||
+      header.recordSize != expected.recordSize) {
+    std::cerr << binPath << " has record layout v" << header.version << " ("
+              << header.recordSize << " bytes), this build reads v"
+              << expected.version << " (" << expected.recordSize
+              << " bytes)\n";
+    return false;
+  }
+
+  std::ofstream csv(csvPath);
+  if (!csv.is_open()) {
+    std::cerr << "Failed to open " << csvPath << "\n";
+    return false;
+  }
+  writeTelemetryCsvHeader(csv);
+  TelemetryRecord record;
+  // A truncated last record (the program died mid-write) is ignored
+  while (in.read(reinterpret_cast<char *>(&record), sizeof(record)))
+    writeTelemetryCsvRow(csv, record);
+  return true;
+}
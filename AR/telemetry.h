@@ -0,0 +1,98 @@
+#pragma once
+
+#include "spsc_queue.h"
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+// One rendered frame as logged. Plain data so it can be copied into the ring
+// and written to disk byte for byte; fields follow the ar_log.csv columns.
+// Times ending in Ms are milliseconds since program start unless noted.
+struct TelemetryRecord {
+  uint64_t frame = 0;
+  uint64_t dropped = 0;
+  double capMs = 0.0, pnpMs = 0.0, uploadMs = 0.0, swapMs = 0.0;
+  double t[3] = {0.0, 0.0, 0.0};
+  double r[3] = {0.0, 0.0, 0.0};
+  double reprojMean = -1.0, reprojMedian = -1.0, reprojMax = -1.0;
+  // Durations
+  double detectMs = 0.0, poseMs = 0.0;
+  double gpuUploadMs = 0.0, gpuDrawMs = 0.0;
+  double gpuDoneMs = 0.0; // timestamp
+  double uploadCpuMs = 0.0;
+  double convertMs = 0.0, convertSavedMs = 0.0;
+  // Per-stage breakdown from the scoped timers (common/profiler.h)
+  double grayMs = 0.0, subPixMs = 0.0, reprojMs = 0.0;
+  double imguiMs = 0.0, drawCpuMs = 0.0;
+  uint32_t captureQueue = 0, resultQueue = 0;
+  int32_t pboInFlight = 0;
+  int8_t pyramidLevel = -1;
+  // LatencyController rung, -1 without a budget
+  int8_t qualityLevel = -1;
+  uint8_t detectMode = 0; // DetectMode
+  uint8_t found = 0;
+};
+
+static_assert(std::is_trivially_copyable<TelemetryRecord>::value,
+              "telemetry records are written as raw bytes");
+
+// Header of a binary telemetry file, followed by packed TelemetryRecords.
+struct TelemetryHeader {
+  char magic[4] = {'A', 'R', 'T', 'L'};
+  // Bump when TelemetryRecord changes
+  uint32_t version = 3;
+  uint32_t recordSize = sizeof(TelemetryRecord);
+  uint32_t reserved = 0;
+};
+
+// Writes TelemetryRecords to a binary file from a background thread.
+//
+// push() only copies the record into a lock-free ring and never blocks, so
+// the render loop pays neither formatting nor file I/O. The writer thread
+// drains the ring and flushes to disk about once a second. If it falls
+// behind and the ring fills up, records are dropped and counted instead of
+// stalling the caller.
+class TelemetryWriter {
+public:
+  TelemetryWriter(const std::string &path, size_t capacity = 4096);
+  // Writes everything still queued and closes the file.
+  ~TelemetryWriter();
+  TelemetryWriter(const TelemetryWriter &) = delete;
+  TelemetryWriter &operator=(const TelemetryWriter &) = delete;
+
+  bool isOpen() const { return isOpen_; }
+
+  // Single producer only.
+  bool push(const TelemetryRecord &record);
+
+  size_t queued() const { return queue_.size(); }
+  uint64_t written() const { return written_; }
+  uint64_t dropped() const { return dropped_; }
+
+private:
+  void writeLoop();
+
+  std::ofstream out_;
+  bool isOpen_ = false;
+  SpscQueue<TelemetryRecord> queue_;
+  std::atomic<bool> running_{false};
+  std::atomic<uint64_t> written_{0};
+  std::atomic<uint64_t> dropped_{0};
+  std::thread thread_;
+};
+
+// ar_log.csv column names and one row per record, in the order the
+// analysis script expects.
+void writeTelemetryCsvHeader(std::ostream &os);
+void writeTelemetryCsvRow(std::ostream &os, const TelemetryRecord &record);
+
+// Converts a binary telemetry file into the ar_log.csv layout. Returns false
+// (after printing why) if the input is missing or was written by a
+// different record layout.
+bool convertTelemetryToCsv(const std::string &binPath,
+                           const std::string &csvPath);
@@ -0,0 +1,155 @@
+#include "texture_streamer.h"
+
+#include <algorithm>
+#include <chrono>
+
+const char *uploadModeName(UploadMode mode) {
+  return mode == UploadMode::Pbo ? "pbo" : "direct";
+}
+
+bool parseUploadMode(const std::string &name, UploadMode &mode) {
+  if (name == "direct")
+    mode = UploadMode::Direct;
+  else if (name == "pbo")
+    mode = UploadMode::Pbo;
+  else
+    return false;
+  return true;
+}
+
+TextureStreamer::TextureStreamer(int width, int height, UploadMode mode,
+                                 bool bgrFrames)
+    : width_(width), height_(height), mode_(mode), bgrFrames_(bgrFrames) {
+  create();
+}
+
+TextureStreamer::~TextureStreamer() { destroy(); }
+
+void TextureStreamer::create() {
+  glGenTextures(1, &texture_);
+  glBindTexture(GL_TEXTURE_2D, texture_);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  if (mode_ == UploadMode::Direct) {
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width_, height_, 0, GL_RGB,
+                 GL_UNSIGNED_BYTE, nullptr);
+    return;
+  }
+
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width_, height_, 0, GL_BGRA,
+               GL_UNSIGNED_INT_8_8_8_8_REV, nullptr);
+  bufferBytes_ = static_cast<size_t>(width_) * height_ * 4;
+  persistent_ = GLAD_GL_VERSION_4_4 != 0;
+  glGenBuffers(kRingSize, buffers_);
+  for (int i = 0; i < kRingSize; ++i) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers_[i]);
+    if (persistent_) {
+      const GLbitfield flags =
+          GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+      glBufferStorage(GL_PIXEL_UNPACK_BUFFER, bufferBytes_, nullptr, flags);
+      mapped_[i] =
+          glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bufferBytes_, flags);
+    } else {
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, bufferBytes_, nullptr,
+                   GL_STREAM_DRAW);
+    }
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void TextureStreamer::destroy() {
+  for (int i = 0; i < kRingSize; ++i) {
+    if (fences_[i])
+      glDeleteSync(fences_[i]);
+    if (mapped_[i]) {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers_[i]);
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+    fences_[i] = nullptr;
+    mapped_[i] = nullptr;
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  if (mode_ == UploadMode::Pbo)
+    glDeleteBuffers(kRingSize, buffers_);
+  glDeleteTextures(1, &texture_);
+  std::fill(buffers_, buffers_ + kRingSize, 0u);
+  texture_ = 0;
+  next_ = 0;
+}
+
+void TextureStreamer::upload(const cv::Mat &frame) {
+  auto t_start = std::chrono::high_resolution_clock::now();
+  if (frame.cols != width_ || frame.rows != height_) {
+    // The staging view over a buffer must match the frame exactly, or
+    // cvtColor reallocates it away from the buffer and the GPU gets stale
+    // contents
+    destroy();
+    width_ = frame.cols;
+    height_ = frame.rows;
+    create();
+    ++stats_.resizes;
+  }
+  if (mode_ == UploadMode::Pbo)
+    uploadPbo(frame);
+  else
+    uploadDirect(frame);
+  stats_.writeMs = std::chrono::duration<double, std::milli>(
+                       std::chrono::high_resolution_clock::now() - t_start)
+                       .count();
+  ++stats_.uploads;
+}
+
+void TextureStreamer::uploadDirect(const cv::Mat &frame) {
+  glBindTexture(GL_TEXTURE_2D, texture_);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, frame.cols, frame.rows, GL_RGB,
+                  GL_UNSIGNED_BYTE, frame.data);
+}
+
+void TextureStreamer::uploadPbo(const cv::Mat &frame) {
+  int inFlight = 0;
+  for (GLsync fence : fences_) {
+    if (fence && glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+      ++inFlight;
+  }
+  stats_.inFlight = inFlight;
+
+  const int slot = next_;
+  next_ = (next_ + 1) % kRingSize;
+  if (GLsync fence = fences_[slot]) {
+    // Only blocks when the GPU is a whole ring behind
+    if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+      ++stats_.waits;
+      while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) ==
+             GL_TIMEOUT_EXPIRED) {
+      }
+    }
+    glDeleteSync(fence);
+    fences_[slot] = nullptr;
+  }
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers_[slot]);
+  void *dst = mapped_[slot];
+  if (!persistent_) {
+    // The fence already guarantees the GPU is done with this buffer
+    dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bufferBytes_,
+                           GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT |
+                               GL_MAP_UNSYNCHRONIZED_BIT);
+  }
+  if (dst) {
+    // Expand to BGRA straight into the buffer: one pass, no extra copy
+    cv::Mat staging(height_, width_, CV_8UC4, dst);
+    cv::cvtColor(frame, staging,
+                 bgrFrames_ ? cv::COLOR_BGR2BGRA : cv::COLOR_RGB2BGRA);
+  }
+  if (!persistent_)
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+  glBindTexture(GL_TEXTURE_2D, texture_);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width_, height_, GL_BGRA,
+                  GL_UNSIGNED_INT_8_8_8_8_REV, nullptr);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  fences_[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
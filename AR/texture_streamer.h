@@ -0,0 +1,92 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include <string>
+
+// How camera frames get into the background texture.
+enum class UploadMode {
+  Direct, // glTexSubImage2D straight from the frame, 3-byte RGB rows
+  Pbo,    // staged through a ring of pixel buffer objects as 4-byte BGRA
+};
+
+const char *uploadModeName(UploadMode mode);
+// Parses the names returned by uploadModeName(). Returns false if unknown.
+bool parseUploadMode(const std::string &name, UploadMode &mode);
+
+// Owns the video background texture and streams frames into it.
+//
+// Frames are either RGB or the raw BGR capture. The PBO path writes BGRA
+// from both at the same cost, so its texture always holds correct colours;
+// the direct path uploads the bytes untouched and a BGR texture then has
+// red and blue swapped, which swapsRedBlue() tells the screen shader.
+//
+// In Pbo mode each frame is written into the next buffer of a small ring
+// and the texture update is sourced from that buffer, so glTexSubImage2D
+// returns immediately and the copy to the texture overlaps with the CPU
+// writing the following frame into another buffer. A fence per buffer keeps
+// the CPU from overwriting one the GPU is still reading. Staging is 4-byte
+// BGRA, the layout drivers can copy without repacking; the RGB -> BGRA
+// expansion happens in the same pass that writes the buffer. On GL 4.4+ the
+// buffers are created with glBufferStorage and stay persistently mapped;
+// otherwise each one is mapped for the write and unmapped again.
+//
+// Needs a current GL 3.3 context for its whole lifetime.
+class TextureStreamer {
+public:
+  static const int kRingSize = 3;
+
+  // Upload cost and ring occupancy, updated by upload()
+  struct Stats {
+    double writeMs = 0.0; // CPU time of the last upload() call
+    uint64_t uploads = 0;
+    // Uploads that found their buffer still in use by the GPU and waited
+    uint64_t waits = 0;
+    // Buffers the GPU had not finished with when the last upload started
+    int inFlight = 0;
+    // Times a frame of another size made the texture and ring be recreated
+    uint64_t resizes = 0;
+  };
+
+  TextureStreamer(int width, int height, UploadMode mode, bool bgrFrames);
+  ~TextureStreamer();
+  TextureStreamer(const TextureStreamer &) = delete;
+  TextureStreamer &operator=(const TextureStreamer &) = delete;
+
+  // `frame` is an 8-bit 3-channel frame in the channel order given at
+  // construction. Rows are uploaded in memory order. A frame of another
+  // size than the texture recreates the texture and the ring for it first.
+  // Leaves the texture bound to GL_TEXTURE_2D.
+  void upload(const cv::Mat &frame);
+
+  GLuint texture() const { return texture_; }
+  UploadMode mode() const { return mode_; }
+  bool persistent() const { return persistent_; }
+  // True if the texture holds the frame's channels as B, G, R
+  bool swapsRedBlue() const {
+    return bgrFrames_ && mode_ == UploadMode::Direct;
+  }
+  const Stats &stats() const { return stats_; }
+
+private:
+  void create();
+  void destroy();
+  void uploadDirect(const cv::Mat &frame);
+  void uploadPbo(const cv::Mat &frame);
+
+  int width_, height_;
+  UploadMode mode_;
+  bool bgrFrames_;
+  GLuint texture_ = 0;
+
+  GLuint buffers_[kRingSize] = {};
+  GLsync fences_[kRingSize] = {};
+  void *mapped_[kRingSize] = {}; // persistent mappings
+  bool persistent_ = false;
+  size_t bufferBytes_ = 0;
+  int next_ = 0;
+
+  Stats stats_;
+};
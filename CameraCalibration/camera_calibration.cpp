@@ -3,6 +3,11 @@
 #include <string>
 #include <ctime>
 #include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <thread>
 
 #include <opencv2/core.hpp>
 #include <opencv2/core/utility.hpp>
@@ -13,13 +18,20 @@
 #include <opencv2/highgui.hpp>
 #include "opencv2/objdetect/charuco_detector.hpp"
 
+#include "common/profiler.h"
+#include "common/undistort_maps.h"
+#include "corner_cache.h"
+#include "image_prefetcher.h"
+#include "incremental_calibrator.h"
+#include "view_selector.h"
+
 using namespace cv;
 using namespace std;
 
 class Settings
 {
 public:
-    Settings() : goodInput(false) {}
+    Settings() : imreadFlags(IMREAD_COLOR), viewReport(false), goodInput(false) {}
     enum Pattern { NOT_EXISTING, CHESSBOARD, CHARUCOBOARD, CIRCLES_GRID, ASYMMETRIC_CIRCLES_GRID };
     enum InputType { INVALID, CAMERA, VIDEO_FILE, IMAGE_LIST };
 
@@ -174,12 +186,25 @@ public:
             inputCapture >> view0;
             view0.copyTo(result);
         }
+        else if( prefetcher && atImageList < imageList.size() )
+        {
+            result = prefetcher->next();
+            ++atImageList;
+        }
         else if( atImageList < imageList.size() )
-            result = imread(imageList[atImageList++], IMREAD_COLOR);
+            result = imread(imageList[atImageList++], imreadFlags);
 
         return result;
     }
 
+    // Image lists only: decode the next `depth` images ahead on `threads` background threads
+    void startPrefetch(size_t depth, int threads)
+    {
+        if (inputType == IMAGE_LIST && depth > 0)
+            prefetcher = std::make_shared<ImagePrefetcher>(imageList, atImageList, depth, threads,
+                                                           imreadFlags);
+    }
+
     static bool readStringList( const string& filename, vector<string>& l )
     {
         l.clear();
@@ -233,6 +258,9 @@ public:
     int cameraID;
     vector<string> imageList;
     size_t atImageList;
+    int imreadFlags;             // IMREAD_COLOR, or IMREAD_GRAYSCALE when colour is not needed
+    std::shared_ptr<ImagePrefetcher> prefetcher;
+    bool viewReport;             // Print view coverage and solve time against view count when calibrating
     VideoCapture inputCapture;
     InputType inputType;
     bool goodInput;
@@ -256,6 +284,14 @@ enum { DETECTION = 0, CAPTURING = 1, CALIBRATED = 2 };
 
 bool runCalibrationAndSave(Settings& s, Size imageSize, Mat&  cameraMatrix, Mat& distCoeffs,
                            vector<vector<Point2f> > imagePoints, float grid_width, bool release_object);
+static bool findPattern(const Settings& s, const Mat& view, const cv::aruco::CharucoDetector& ch_detector,
+                        int winSize, vector<Point2f>& pointBuf);
+static Size patternGrid(const Settings& s);
+static vector<Point3f> boardModel(const Settings& s, float grid_width);
+static vector<string> incrementalStatus(const IncrementalResult& r);
+static void detectImageListBatch(const Settings& s, const cv::aruco::CharucoBoard& ch_board, int winSize,
+                                 int threads, CornerCache* cornerCache,
+                                 vector<vector<Point2f> >& imagePoints, Size& imageSize);
 
 int main(int argc, char* argv[])
 {
@@ -264,7 +300,31 @@ int main(int argc, char* argv[])
           "{@settings      |default.xml| input setting file            }"
           "{d              |           | actual distance between top-left and top-right corners of "
           "the calibration grid }"
-          "{winSize        | 11        | Half of search window for cornerSubPix }";
+          "{winSize        | 11        | Half of search window for cornerSubPix }"
+          "{profile        | false     | print per-stage timings on exit }"
+          "{batch          | false     | with an image list, decode and search all images on a thread "
+          "pool, then calibrate without showing them one by one }"
+          "{threads        | 0         | worker threads for --batch, 0 = one per core }"
+          "{prefetch       | 4         | decode this many images of an image list ahead on background "
+          "threads, 0 = read each one when it is needed }"
+          "{prefetch-threads| 2        | decoder threads for --prefetch }"
+          "{corner-cache   |           | keep the corners found in image-list images in this file and "
+          "reuse them while the images and detector settings stay the same }"
+          "{select-views   | false     | keep only views that cover new parts of the image or show the "
+          "board at a new position, distance or tilt }"
+          "{min-gain       | 0.2       | with --select-views, the least coverage + pose gain (0..1) a "
+          "view needs to be kept }"
+          "{view-report    | false     | when calibrating, print the corner coverage of the views and "
+          "the solve time and result for subsets of them }"
+          "{incremental    | false     | re-calibrate on a background thread after every captured view, "
+          "starting from the previous result, and show the converging error and uncertainty }"
+          "{stable-tol     | 0.002     | with --incremental, stop capturing once fx, fy, cx and cy changed "
+          "by less than this fraction in 3 solves in a row; 0 = always take all frames }"
+          "{gray           | false     | decode image-list images straight to grayscale, which is "
+          "all the pattern search needs }"
+          "{undistort-bench| 0         | after calibrating, time N frames of per-frame undistort "
+          "against remap with the precomputed maps }"
+          "{trace          |           | write a Chrome trace-event JSON of every stage to this file on exit }";
     CommandLineParser parser(argc, argv, keys);
     parser.about("This is a camera calibration sample.\n"
                  "Usage: camera_calibration [configuration_file -- default ./default.xml]\n"
@@ -301,6 +361,41 @@ int main(int argc, char* argv[])
     }
 
     int winSize = parser.get<int>("winSize");
+    int undistortBench = parser.get<int>("undistort-bench");
+    const bool batch = parser.get<bool>("batch") && s.inputType == Settings::IMAGE_LIST;
+    int threads = parser.get<int>("threads");
+    if (parser.get<bool>("gray"))
+        s.imreadFlags = IMREAD_GRAYSCALE;
+    const bool selectViews = parser.get<bool>("select-views");
+    const double minGain = parser.get<double>("min-gain");
+    s.viewReport = parser.get<bool>("view-report");
+    const bool incremental = parser.get<bool>("incremental");
+    const double stableTolerance = std::max(0.0, parser.get<double>("stable-tol"));
+    Profiler::setEnabled(parser.get<bool>("profile"));
+    const string tracePath = parser.get<string>("trace");
+    if (!tracePath.empty())
+    {
+        Profiler::startTrace();
+        Profiler::setThreadName("main");
+    }
+    // After the trace has started, so the first decodes are in it too
+    if (!batch)
+        s.startPrefetch(std::max(0, parser.get<int>("prefetch")), parser.get<int>("prefetch-threads"));
+
+    std::unique_ptr<CornerCache> cornerCache;
+    const string cornerCachePath = parser.get<string>("corner-cache");
+    if (!cornerCachePath.empty() && s.inputType == Settings::IMAGE_LIST)
+    {
+        // Everything the detected corners depend on besides the image itself
+        const string detectorParams = format(
+            "pattern=%d board=%dx%d winSize=%d fisheye=%d flip=%d square=%g marker=%g dict=%s|%s "
+            "imread=%d",
+            (int)s.calibrationPattern, s.boardSize.width, s.boardSize.height, winSize,
+            (int)s.useFisheye, (int)s.flipVertical, s.squareSize, s.markerSize,
+            s.arucoDictName.c_str(), s.arucoDictFileName.c_str(),
+            s.imreadFlags);  // a codec's gray decode differs from cvtColor(BGR2GRAY)
+        cornerCache.reset(new CornerCache(cornerCachePath, detectorParams));
+    }
 
     float grid_width = s.squareSize * (s.boardSize.width - 1);
     if (s.calibrationPattern == Settings::Pattern::CHARUCOBOARD) {
@@ -358,27 +453,73 @@ int main(int argc, char* argv[])
     }
     cv::aruco::CharucoBoard ch_board({s.boardSize.width, s.boardSize.height}, s.squareSize, s.markerSize, dictionary);
     cv::aruco::CharucoDetector ch_detector(ch_board);
-    std::vector<int> markerIds;
 
     vector<vector<Point2f> > imagePoints;
     Mat cameraMatrix, distCoeffs;
     Size imageSize;
+    // Views kept so far, with --select-views
+    std::unique_ptr<ViewSelector> viewSelector;
+    // Background solver while capturing, with --incremental. A solver that is
+    // done with is stopped and parked here, so the preview does not wait for
+    // its last solve; the solves cannot be interrupted, so exit waits instead.
+    std::vector<std::unique_ptr<IncrementalCalibrator> > retiredCalibrators;
+    std::unique_ptr<IncrementalCalibrator> calibrator;
+    auto retireCalibrator = [&]() {
+        if (!calibrator)
+            return;
+        calibrator->stop();
+        retiredCalibrators.push_back(std::move(calibrator));
+    };
+    uint64_t reportedUpdates = 0;
+    // Undistortion maps for the current calibration and image size
+    UndistortMaps undistortMaps;
+    Mat undistortedView;
     int mode = s.inputType == Settings::IMAGE_LIST ? CAPTURING : DETECTION;
     clock_t prevTimestamp = 0;
     const Scalar RED(0,0,255), GREEN(0,255,0);
     const char ESC_KEY = 27;
+
+    if (batch)
+    {
+        detectImageListBatch(s, ch_board, winSize, threads, cornerCache.get(), imagePoints, imageSize);
+        if (selectViews && !imagePoints.empty())
+        {
+            // Best of all views instead of the first ones
+            viewSelector.reset(new ViewSelector(imageSize, patternGrid(s), minGain));
+            const vector<size_t> chosen = viewSelector->select(imagePoints, s.nrFrames);
+            vector<vector<Point2f> > selected;
+            for (size_t i : chosen)
+                selected.push_back(imagePoints[i]);
+            cout << "Selected " << selected.size() << " of " << imagePoints.size() << " views" << endl;
+            imagePoints.swap(selected);
+        }
+        else if (imagePoints.size() > (size_t)s.nrFrames)
+            imagePoints.resize(s.nrFrames);
+        if (!imagePoints.empty())
+            runCalibrationAndSave(s, imageSize, cameraMatrix, distCoeffs, imagePoints, grid_width,
+                                  release_object);
+    }
     //! [get_input]
 
-    for(;;)
+    // Interactive detection; the batch mode has done all of it already
+    for(uint64_t frame = 0; !batch; ++frame)
     {
         Mat view;
         bool blinkOutput = false;
+        Profiler::setFrame(frame);
 
-        view = s.nextImage();
+        {
+            PROFILE_SCOPE("calib/next_image");
+            view = s.nextImage();
+        }
 
         //-----  If no more image, or got enough, then stop calibration and show result -------------
-        if( mode == CAPTURING && imagePoints.size() >= (size_t)s.nrFrames )
+        const bool converged = calibrator && calibrator->stable();
+        if( mode == CAPTURING && (imagePoints.size() >= (size_t)s.nrFrames || converged) )
         {
+          if (converged)
+              cout << "Intrinsics stable after " << imagePoints.size() << " views" << endl;
+          retireCalibrator();
           if(runCalibrationAndSave(s, imageSize,  cameraMatrix, distCoeffs, imagePoints, grid_width,
                                    release_object))
               mode = CALIBRATED;
@@ -397,56 +538,40 @@ int main(int argc, char* argv[])
 
         imageSize = view.size();  // Format input image.
         if( s.flipVertical )    flip( view, view, 0 );
+        if (selectViews && !viewSelector)
+            viewSelector.reset(new ViewSelector(imageSize, patternGrid(s), minGain));
 
         //! [find_pattern]
         vector<Point2f> pointBuf;
 
         bool found;
-
-        int chessBoardFlags = CALIB_CB_ADAPTIVE_THRESH | CALIB_CB_NORMALIZE_IMAGE;
-
-        if(!s.useFisheye) {
-            // fast check erroneously fails with high distortions like fisheye
-            chessBoardFlags |= CALIB_CB_FAST_CHECK;
-        }
-
-        switch( s.calibrationPattern ) // Find feature points on the input format
+        Size cachedSize;
+        if (!cornerCache ||
+            !cornerCache->lookup(s.imageList[s.atImageList - 1], found, cachedSize, pointBuf))
         {
-        case Settings::CHESSBOARD:
-            found = findChessboardCorners( view, s.boardSize, pointBuf, chessBoardFlags);
-            break;
-        case Settings::CHARUCOBOARD:
-            ch_detector.detectBoard( view, pointBuf, markerIds);
-            found = pointBuf.size() == (size_t)((s.boardSize.height - 1)*(s.boardSize.width - 1));
-            break;
-        case Settings::CIRCLES_GRID:
-            found = findCirclesGrid( view, s.boardSize, pointBuf );
-            break;
-        case Settings::ASYMMETRIC_CIRCLES_GRID:
-            found = findCirclesGrid( view, s.boardSize, pointBuf, CALIB_CB_ASYMMETRIC_GRID );
-            break;
-        default:
-            found = false;
-            break;
+            found = findPattern(s, view, ch_detector, winSize, pointBuf);
+            if (cornerCache)
+                cornerCache->store(s.imageList[s.atImageList - 1], found, view.size(), pointBuf);
         }
         //! [find_pattern]
 
         //! [pattern_found]
         if (found)                // If done with success,
         {
-              // improve the found corners' coordinate accuracy for chessboard
-                if( s.calibrationPattern == Settings::CHESSBOARD)
-                {
-                    Mat viewGray;
-                    cvtColor(view, viewGray, COLOR_BGR2GRAY);
-                    cornerSubPix( viewGray, pointBuf, Size(winSize,winSize),
-                        Size(-1,-1), TermCriteria( TermCriteria::EPS+TermCriteria::COUNT, 30, 0.0001 ));
-                }
-
                 if( mode == CAPTURING &&  // For camera only take new samples after delay time
-                    (!s.inputCapture.isOpened() || clock() - prevTimestamp > s.delay*1e-3*CLOCKS_PER_SEC) )
+                    (!s.inputCapture.isOpened() || clock() - prevTimestamp > s.delay*1e-3*CLOCKS_PER_SEC) &&
+                    (!viewSelector || viewSelector->consider(pointBuf)) )  // only views that add something
                 {
                     imagePoints.push_back(pointBuf);
+                    if (incremental)
+                    {
+                        if (!calibrator)
+                            calibrator.reset(new IncrementalCalibrator(boardModel(s, grid_width), imageSize,
+                                                                       s.flag, s.useFisheye, s.aspectRatio,
+                                                                       release_object ? s.boardSize.width - 1 : -1,
+                                                                       stableTolerance));
+                        calibrator->addView(pointBuf);
+                    }
                     prevTimestamp = clock();
                     blinkOutput = s.inputCapture.isOpened();
                 }
@@ -476,6 +601,21 @@ int main(int argc, char* argv[])
 
         putText( view, msg, textOrigin, 1, 1, mode == CALIBRATED ?  GREEN : RED);
 
+        if (calibrator && mode == CAPTURING)
+        {
+            const IncrementalResult r = calibrator->result();
+            const vector<string> lines = incrementalStatus(r);
+            const bool stable = r.stableUpdates >= IncrementalCalibrator::kStableUpdates;
+            for (size_t i = 0; i < lines.size(); ++i)
+                putText(view, lines[i], Point(10, 20 + 20 * (int)i), 1, 1, stable ? GREEN : RED);
+            if (r.updates != reportedUpdates)
+            {
+                for (const string& line : lines)
+                    cout << line << endl;
+                reportedUpdates = r.updates;
+            }
+        }
+
         if( blinkOutput )
             bitwise_not(view, view);
         //! [output_text]
@@ -483,22 +623,25 @@ int main(int argc, char* argv[])
         //! [output_undistorted]
         if( mode == CALIBRATED && s.showUndistorted )
         {
-            Mat temp = view.clone();
-            if (s.useFisheye)
+            // The maps are built on the first frame after every calibration and reused until the
+            // next one. Same views as undistort() and undistortImage() with balance 1 gave before.
+            undistortMaps.update(cameraMatrix, distCoeffs, imageSize, s.useFisheye, s.useFisheye ? 1 : -1);
+            if (undistortBench > 0)
             {
-                Mat newCamMat;
-                fisheye::estimateNewCameraMatrixForUndistortRectify(cameraMatrix, distCoeffs, imageSize,
-                                                                    Matx33d::eye(), newCamMat, 1);
-                cv::fisheye::undistortImage(temp, view, cameraMatrix, distCoeffs, newCamMat);
+                benchmarkUndistortion(view, cameraMatrix, distCoeffs, s.useFisheye, undistortBench, cout);
+                undistortBench = 0;
             }
-            else
-              undistort(temp, view, cameraMatrix, distCoeffs);
+            PROFILE_SCOPE("calib/undistort");
+            undistortMaps.apply(view, undistortedView);
+            view = undistortedView;
         }
         //! [output_undistorted]
         //------------------------------ Show image and check for input commands -------------------
         //! [await_input]
+        PROFILE_TIMER(showTimer, "calib/show");   // includes the waitKey delay
         imshow("Image View", view);
         char key = (char)waitKey(s.inputCapture.isOpened() ? 50 : s.delay);
+        showTimer.stop();
 
         if( key  == ESC_KEY )
             break;
@@ -510,38 +653,45 @@ int main(int argc, char* argv[])
         {
             mode = CAPTURING;
             imagePoints.clear();
+            viewSelector.reset();
+            retireCalibrator();
         }
         //! [await_input]
     }
 
+    if (s.prefetcher)
+    {
+        s.prefetcher->printStats(cout);
+        s.prefetcher.reset();
+    }
+    if (cornerCache)
+    {
+        cornerCache->save();
+        cornerCache->printStats(cout);
+    }
+
     // -----------------------Show the undistorted image for the image list ------------------------
     //! [show_results]
     if( s.inputType == Settings::IMAGE_LIST && s.showUndistorted && !cameraMatrix.empty())
     {
-        Mat view, rview, map1, map2;
-
-        if (s.useFisheye)
-        {
-            Mat newCamMat;
-            fisheye::estimateNewCameraMatrixForUndistortRectify(cameraMatrix, distCoeffs, imageSize,
-                                                                Matx33d::eye(), newCamMat, 1);
-            fisheye::initUndistortRectifyMap(cameraMatrix, distCoeffs, Matx33d::eye(), newCamMat, imageSize,
-                                             CV_16SC2, map1, map2);
-        }
-        else
-        {
-            initUndistortRectifyMap(
-                cameraMatrix, distCoeffs, Mat(),
-                getOptimalNewCameraMatrix(cameraMatrix, distCoeffs, imageSize, 1, imageSize, 0), imageSize,
-                CV_16SC2, map1, map2);
-        }
+        Mat view, rview;
+        // Keeps every source pixel in view
+        undistortMaps.update(cameraMatrix, distCoeffs, imageSize, s.useFisheye, 1);
 
         for(size_t i = 0; i < s.imageList.size(); i++ )
         {
             view = imread(s.imageList[i], IMREAD_COLOR);
             if(view.empty())
                 continue;
-            remap(view, rview, map1, map2, INTER_LINEAR);
+            if (undistortBench > 0)
+            {
+                benchmarkUndistortion(view, cameraMatrix, distCoeffs, s.useFisheye, undistortBench, cout);
+                undistortBench = 0;
+            }
+            {
+                PROFILE_SCOPE("calib/remap");
+                undistortMaps.apply(view, rview);
+            }
             imshow("Image View", rview);
             char c = (char)waitKey();
             if( c  == ESC_KEY || c == 'q' || c == 'Q' )
@@ -550,9 +700,182 @@ int main(int argc, char* argv[])
     }
     //! [show_results]
 
+    if (Profiler::enabled())
+        Profiler::printReport(cout);
+    if (!tracePath.empty())
+        Profiler::writeTrace(tracePath);
     return 0;
 }
 
+// Finds the calibration pattern in a BGR or grayscale view; chessboard corners are refined with cornerSubPix.
+static bool findPattern(const Settings& s, const Mat& view, const cv::aruco::CharucoDetector& ch_detector,
+                        int winSize, vector<Point2f>& pointBuf)
+{
+    bool found;
+
+    int chessBoardFlags = CALIB_CB_ADAPTIVE_THRESH | CALIB_CB_NORMALIZE_IMAGE;
+    PROFILE_TIMER(findTimer, "calib/find_pattern");
+
+    if(!s.useFisheye) {
+        // fast check erroneously fails with high distortions like fisheye
+        chessBoardFlags |= CALIB_CB_FAST_CHECK;
+    }
+
+    switch( s.calibrationPattern ) // Find feature points on the input format
+    {
+    case Settings::CHESSBOARD:
+        found = findChessboardCorners( view, s.boardSize, pointBuf, chessBoardFlags);
+        break;
+    case Settings::CHARUCOBOARD:
+    {
+        vector<int> markerIds;
+        ch_detector.detectBoard( view, pointBuf, markerIds);
+        found = pointBuf.size() == (size_t)((s.boardSize.height - 1)*(s.boardSize.width - 1));
+        break;
+    }
+    case Settings::CIRCLES_GRID:
+        found = findCirclesGrid( view, s.boardSize, pointBuf );
+        break;
+    case Settings::ASYMMETRIC_CIRCLES_GRID:
+        found = findCirclesGrid( view, s.boardSize, pointBuf, CALIB_CB_ASYMMETRIC_GRID );
+        break;
+    default:
+        found = false;
+        break;
+    }
+    findTimer.stop();
+
+    // improve the found corners' coordinate accuracy for chessboard
+    if( found && s.calibrationPattern == Settings::CHESSBOARD)
+    {
+        Mat viewGray = view;
+        if (view.channels() != 1)
+        {
+            PROFILE_SCOPE("calib/gray");
+            cvtColor(view, viewGray, COLOR_BGR2GRAY);
+        }
+        PROFILE_SCOPE("calib/subpix");
+        cornerSubPix( viewGray, pointBuf, Size(winSize,winSize),
+            Size(-1,-1), TermCriteria( TermCriteria::EPS+TermCriteria::COUNT, 30, 0.0001 ));
+    }
+    return found;
+}
+
+// Decodes and searches every image of an IMAGE_LIST on a pool of `threads` workers (0: one per
+// core). Each image's result is stored at its list index and imagePoints is filled with every view
+// that has the pattern in list order afterwards, so the calibration does not depend on scheduling;
+// the caller picks the views to calibrate with. Prints per-image timings and the throughput.
+static void detectImageListBatch(const Settings& s, const cv::aruco::CharucoBoard& ch_board, int winSize,
+                                 int threads, CornerCache* cornerCache,
+                                 vector<vector<Point2f> >& imagePoints, Size& imageSize)
+{
+    typedef std::chrono::steady_clock Clock;
+    struct ImageResult
+    {
+        Size size;
+        vector<Point2f> points;
+        bool found = false;
+        bool cached = false;
+        double decodeMs = 0, detectMs = 0;
+    };
+    const size_t count = s.imageList.size();
+    vector<ImageResult> results(count);
+    std::atomic<size_t> next(0);
+    if (threads <= 0)
+        threads = (int)std::max(1u, std::thread::hardware_concurrency());
+    threads = (int)std::min<size_t>(threads, std::max<size_t>(count, 1));
+
+    auto worker = [&](int id)
+    {
+        const string name = "batch " + to_string(id);
+        Profiler::setThreadName(name.c_str());
+        // Detectors keep per-call state, so every worker has its own
+        cv::aruco::CharucoDetector ch_detector(ch_board);
+        for (size_t i; (i = next++) < count; )
+        {
+            Profiler::setFrame(i);
+            ImageResult& r = results[i];
+            // A hit needs neither the pixels nor the search
+            if (cornerCache && cornerCache->lookup(s.imageList[i], r.found, r.size, r.points))
+            {
+                r.cached = true;
+                continue;
+            }
+            Clock::time_point t0 = Clock::now();
+            Mat view;
+            {
+                PROFILE_SCOPE("calib/decode");
+                view = imread(s.imageList[i], s.imreadFlags);
+            }
+            Clock::time_point t1 = Clock::now();
+            r.decodeMs = std::chrono::duration<double, std::milli>(t1 - t0).count();
+            if (view.empty())
+                continue;
+            if (s.flipVertical)
+                flip(view, view, 0);
+            r.size = view.size();
+            r.found = findPattern(s, view, ch_detector, winSize, r.points);
+            r.detectMs = std::chrono::duration<double, std::milli>(Clock::now() - t1).count();
+            if (cornerCache)
+                cornerCache->store(s.imageList[i], r.found, r.size, r.points);
+        }
+    };
+
+    // The pool already keeps every core busy; OpenCV's own parallel_for inside the detectors
+    // would only oversubscribe them
+    const int cvThreads = getNumThreads();
+    setNumThreads(1);
+    Clock::time_point start = Clock::now();
+    vector<std::thread> pool;
+    for (int t = 1; t < threads; ++t)
+        pool.emplace_back(worker, t);
+    worker(0);
+    for (std::thread& t : pool)
+        t.join();
+    const double wallMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    setNumThreads(cvThreads);
+
+    double decodeMs = 0, detectMs = 0;
+    size_t found = 0;
+    cout << fixed << setprecision(1);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const ImageResult& r = results[i];
+        decodeMs += r.decodeMs;
+        detectMs += r.detectMs;
+        cout << setw(5) << i + 1 << "/" << count << "  " << s.imageList[i] << "  ";
+        if (r.cached)
+            cout << "cached  ";
+        else
+            cout << "decode " << r.decodeMs << " ms  detect " << r.detectMs << " ms  ";
+        if (r.size.empty())
+        {
+            cout << "cannot read" << endl;
+            continue;
+        }
+        if (imageSize.empty())
+            imageSize = r.size;
+        if (r.size != imageSize)
+        {
+            cout << "skipped, " << r.size << " instead of " << imageSize << endl;
+            continue;
+        }
+        cout << (r.found ? "found" : "not found") << endl;
+        if (!r.found)
+            continue;
+        ++found;
+        imagePoints.push_back(r.points);
+    }
+    cout << "Batch detection: " << found << " of " << count << " images with the pattern in "
+         << wallMs << " ms on " << threads << " threads, " << setprecision(2)
+         << (wallMs > 0 ? count * 1000.0 / wallMs : 0.0) << " images/s" << endl
+         << setprecision(1) << "  per image: decode " << decodeMs / max<size_t>(count, 1)
+         << " ms, detect " << detectMs / max<size_t>(count, 1) << " ms; "
+         << setprecision(2) << (wallMs > 0 ? (decodeMs + detectMs) / wallMs : 0.0)
+         << "x the single-thread rate" << endl;
+    cout.unsetf(ios::floatfield);
+}
+
 //! [compute_errors]
 static double computeReprojectionErrors( const vector<vector<Point3f> >& objectPoints,
                                          const vector<vector<Point2f> >& imagePoints,
@@ -622,10 +945,29 @@ static void calcBoardCornerPositions(Size boardSize, float squareSize, vector<Po
     }
 }
 //! [board_corners]
+// Board corners in board coordinates, as every view sees them
+static vector<Point3f> boardModel(const Settings& s, float grid_width)
+{
+    vector<Point3f> corners;
+    calcBoardCornerPositions(s.boardSize, s.squareSize, corners, s.calibrationPattern);
+
+    // Board imperfectness correction introduced in PR #12772
+    // The correction does not make sense for asymmetric and assymetric circles grids
+    if (s.calibrationPattern == Settings::Pattern::CHARUCOBOARD)
+    {
+        corners[s.boardSize.width - 2].x = corners[0].x + grid_width;
+    }
+    else if (s.calibrationPattern == Settings::Pattern::CHESSBOARD)
+    {
+        corners[s.boardSize.width - 1].x = corners[0].x + grid_width;
+    }
+    return corners;
+}
+
 static bool runCalibration( Settings& s, Size& imageSize, Mat& cameraMatrix, Mat& distCoeffs,
                             vector<vector<Point2f> > imagePoints, vector<Mat>& rvecs, vector<Mat>& tvecs,
                             vector<float>& reprojErrs,  double& totalAvgErr, vector<Point3f>& newObjPoints,
-                            float grid_width, bool release_object)
+                            float grid_width, bool release_object, bool verbose = true)
 {
     //! [fixed_aspect]
     cameraMatrix = Mat::eye(3, 3, CV_64F);
@@ -638,19 +980,7 @@ static bool runCalibration( Settings& s, Size& imageSize, Mat& cameraMatrix, Mat
         distCoeffs = Mat::zeros(8, 1, CV_64F);
     }
 
-    vector<vector<Point3f> > objectPoints(1);
-    calcBoardCornerPositions(s.boardSize, s.squareSize, objectPoints[0], s.calibrationPattern);
-
-    // Board imperfectness correction introduced in PR #12772
-    // The correction does not make sense for asymmetric and assymetric circles grids
-    if (s.calibrationPattern == Settings::Pattern::CHARUCOBOARD)
-    {
-        objectPoints[0][s.boardSize.width - 2].x = objectPoints[0][0].x + grid_width;
-    }
-    else if (s.calibrationPattern == Settings::Pattern::CHESSBOARD)
-    {
-        objectPoints[0][s.boardSize.width - 1].x = objectPoints[0][0].x + grid_width;
-    }
+    vector<vector<Point3f> > objectPoints(1, boardModel(s, grid_width));
     newObjPoints = objectPoints[0];
 
     objectPoints.resize(imagePoints.size(),objectPoints[0]);
@@ -678,7 +1008,7 @@ static bool runCalibration( Settings& s, Size& imageSize, Mat& cameraMatrix, Mat
                                 s.flag | CALIB_USE_LU);
     }
 
-    if (release_object) {
+    if (release_object && verbose) {
         cout << "New board corners: " << endl;
         cout << newObjPoints[0] << endl;
         cout << newObjPoints[s.boardSize.width - 1] << endl;
@@ -686,7 +1016,8 @@ static bool runCalibration( Settings& s, Size& imageSize, Mat& cameraMatrix, Mat
         cout << newObjPoints.back() << endl;
     }
 
-    cout << "Re-projection error reported by calibrateCamera: "<< rms << endl;
+    if (verbose)
+        cout << "Re-projection error reported by calibrateCamera: "<< rms << endl;
 
     bool ok = checkRange(cameraMatrix) && checkRange(distCoeffs);
 
@@ -817,15 +1148,115 @@ static void saveCameraParams( Settings& s, Size& imageSize, Mat& cameraMatrix, M
     }
 }
 
+// Progress of an incremental calibration as text lines, for the preview and the console
+static vector<string> incrementalStatus(const IncrementalResult& r)
+{
+    vector<string> lines;
+    if (r.updates == 0)
+    {
+        lines.push_back(format("incremental: solving from %d views on", (int)IncrementalCalibrator::kMinViews));
+        return lines;
+    }
+    lines.push_back(format("incremental: %d views  rms %.3f px  solve %.1f ms  change %.3f%%",
+                           (int)r.views, r.rms, r.solveMs, 100 * r.change));
+    // Value with its standard deviation where calibrateCamera estimated one
+    const Mat& sd = r.stdDevIntrinsics;
+    auto param = [&](const char* name, double value, int index) {
+        if (sd.empty())
+            return format("%s %.4g", name, value);
+        return format("%s %.4g +-%.2g", name, value, sd.at<double>(index));
+    };
+    const Mat& K = r.cameraMatrix;
+    lines.push_back(param("fx", K.at<double>(0, 0), 0) + "  " + param("fy", K.at<double>(1, 1), 1) + "  " +
+                    param("cx", K.at<double>(0, 2), 2) + "  " + param("cy", K.at<double>(1, 2), 3));
+    const Mat& D = r.distCoeffs;
+    if (D.total() >= 2)
+        lines.push_back(param("k1", D.at<double>(0), 4) + "  " + param("k2", D.at<double>(1), 5));
+    return lines;
+}
+
+// Corner grid of one detected view, row-major
+static Size patternGrid(const Settings& s)
+{
+    if (s.calibrationPattern == Settings::CHARUCOBOARD)
+        return Size(s.boardSize.width - 1, s.boardSize.height - 1);
+    return s.boardSize;
+}
+
+// Prints the corner coverage of the views, then calibrates with growing prefixes of them (most
+// informative first after --select-views) and prints solve time, error and how far the intrinsics
+// are from the all-views result, to show how many views the accuracy actually needs.
+static void reportViews(Settings& s, Size imageSize, const vector<vector<Point2f> >& imagePoints,
+                        float grid_width, bool release_object)
+{
+    ViewSelector coverage(imageSize, patternGrid(s), 0);
+    for (const vector<Point2f>& view : imagePoints)
+        coverage.add(view);
+    coverage.printCoverage(cout);
+
+    const size_t n = imagePoints.size();
+    vector<size_t> counts;
+    for (size_t step = 1; step <= 8; ++step)
+    {
+        const size_t k = std::max<size_t>(std::min<size_t>(n, 3), n * step / 8);
+        if (counts.empty() || k != counts.back())
+            counts.push_back(k);
+    }
+    struct Result { size_t views; double ms, err; Mat K; bool ok; };
+    vector<Result> results;
+    // Largest first: it is the reference for the others
+    for (size_t i = counts.size(); i-- > 0; )
+    {
+        vector<vector<Point2f> > subset(imagePoints.begin(), imagePoints.begin() + counts[i]);
+        Mat K, D;
+        vector<Mat> rvecs, tvecs;
+        vector<float> reprojErrs;
+        vector<Point3f> newObjPoints;
+        Result r;
+        r.views = counts[i];
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        r.ok = runCalibration(s, imageSize, K, D, subset, rvecs, tvecs, reprojErrs, r.err, newObjPoints,
+                              grid_width, release_object, false);
+        r.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        r.K = K;
+        results.push_back(r);
+    }
+
+    const Mat& ref = results.front().K;
+    cout << "Solve time against view count (intrinsics compared with all " << n << " views):" << endl
+         << " views  solve ms  avg err      fx       fy       cx       cy   dfx %  dc px" << endl
+         << fixed;
+    for (size_t i = results.size(); i-- > 0; )
+    {
+        const Result& r = results[i];
+        if (!r.ok)
+        {
+            cout << setw(6) << r.views << "  calibration failed" << endl;
+            continue;
+        }
+        const double fx = r.K.at<double>(0, 0), fy = r.K.at<double>(1, 1);
+        const double cx = r.K.at<double>(0, 2), cy = r.K.at<double>(1, 2);
+        const double dfx = 100.0 * std::abs(fx - ref.at<double>(0, 0)) / ref.at<double>(0, 0);
+        const double dc = std::hypot(cx - ref.at<double>(0, 2), cy - ref.at<double>(1, 2));
+        cout << setw(6) << r.views << setprecision(1) << setw(10) << r.ms << setprecision(3) << setw(9)
+             << r.err << setprecision(1) << setw(9) << fx << setw(9) << fy << setw(9) << cx << setw(9)
+             << cy << setprecision(2) << setw(8) << dfx << setw(7) << dc << endl;
+    }
+    cout.unsetf(ios::floatfield);
+}
+
 //! [run_and_save]
 bool runCalibrationAndSave(Settings& s, Size imageSize, Mat& cameraMatrix, Mat& distCoeffs,
                            vector<vector<Point2f> > imagePoints, float grid_width, bool release_object)
 {
+    PROFILE_SCOPE("calib/calibrate");
     vector<Mat> rvecs, tvecs;
     vector<float> reprojErrs;
     double totalAvgErr = 0;
     vector<Point3f> newObjPoints;
 
+    if (s.viewReport)
+        reportViews(s, imageSize, imagePoints, grid_width, release_object);
     bool ok = runCalibration(s, imageSize, cameraMatrix, distCoeffs, imagePoints, rvecs, tvecs, reprojErrs,
                              totalAvgErr, newObjPoints, grid_width, release_object);
     cout << (ok ? "Calibration succeeded" : "Calibration failed")
@@ -0,0 +1,192 @@
+#include "corner_cache.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+namespace
+{
+struct CacheHeader
+{
+    char magic[4] = {'C', 'C', 'R', 'N'};
+    uint32_t version = 2;
+    uint64_t paramsHash = 0;
+    uint64_t entryCount = 0;
+};
+
+// Larger values cannot come from a real image list; they mean a corrupt file
+const uint32_t kMaxPathLength = 4096;
+const uint32_t kMaxPointCount = 10000;
+
+struct RecordHeader
+{
+    int64_t mtime;  // nanoseconds
+    uint64_t fileSize;
+    int32_t width, height;
+    uint32_t pathLength;
+    uint32_t pointCount;  // 0 if the pattern was not found
+};
+
+uint64_t fnv1a(const std::string& text)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : text)
+    {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+bool fileStamp(const std::string& path, int64_t& mtime, uint64_t& size)
+{
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0)
+        return false;
+    // Nanoseconds: an image rewritten within the same second at the same
+    // size must not hit
+#ifdef __APPLE__
+    mtime = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+    mtime = static_cast<int64_t>(st.st_mtime) * 1000000000;
+#else
+    mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    size = static_cast<uint64_t>(st.st_size);
+    return true;
+}
+}
+
+CornerCache::CornerCache(const std::string& path, const std::string& detectorParams)
+    : path_(path), paramsHash_(fnv1a(detectorParams))
+{
+    load();
+}
+
+void CornerCache::load()
+{
+    std::ifstream in(path_, std::ios::binary);
+    if (!in.is_open())
+        return;  // first run
+    CacheHeader expected, header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, expected.magic, 4) != 0 || header.version != expected.version)
+    {
+        std::cerr << "Ignoring corner cache " << path_ << ": not a cache file" << std::endl;
+        return;
+    }
+    if (header.paramsHash != paramsHash_)
+    {
+        std::cout << "Corner cache " << path_ << " was made with other detector settings, "
+                  << "detecting again" << std::endl;
+        dirty_ = true;  // rewrite it even if nothing is found
+        return;
+    }
+    for (uint64_t i = 0; i < header.entryCount; ++i)
+    {
+        RecordHeader record;
+        // Oversized lengths are treated like a cut-off file rather than allocated
+        const bool sane = in.read(reinterpret_cast<char*>(&record), sizeof(record)) &&
+                          record.pathLength <= kMaxPathLength &&
+                          record.pointCount <= kMaxPointCount;
+        std::string imagePath(sane ? record.pathLength : 0, '\0');
+        Entry entry;
+        entry.mtime = record.mtime;
+        entry.fileSize = record.fileSize;
+        entry.imageSize = cv::Size(record.width, record.height);
+        entry.found = record.pointCount > 0;
+        entry.points.resize(sane ? record.pointCount : 0);
+        if (!sane || !in.read(&imagePath[0], record.pathLength) ||
+            !in.read(reinterpret_cast<char*>(entry.points.data()),
+                     entry.points.size() * sizeof(cv::Point2f)))
+        {
+            std::cerr << "Corner cache " << path_ << " is truncated after " << i << " entries"
+                      << std::endl;
+            break;
+        }
+        entries_[imagePath] = std::move(entry);
+    }
+    loaded_ = entries_.size();
+}
+
+bool CornerCache::lookup(const std::string& imagePath, bool& found, cv::Size& imageSize,
+                         std::vector<cv::Point2f>& points)
+{
+    int64_t mtime = 0;
+    uint64_t size = 0;
+    const bool stamped = fileStamp(imagePath, mtime, size);
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::string, Entry>::const_iterator it = entries_.find(imagePath);
+    if (!stamped || it == entries_.end() || it->second.mtime != mtime ||
+        it->second.fileSize != size)
+    {
+        ++misses_;
+        return false;
+    }
+    ++hits_;
+    found = it->second.found;
+    imageSize = it->second.imageSize;
+    points = it->second.points;
+    return true;
+}
+
+void CornerCache::store(const std::string& imagePath, bool found, cv::Size imageSize,
+                        const std::vector<cv::Point2f>& points)
+{
+    Entry entry;
+    if (!fileStamp(imagePath, entry.mtime, entry.fileSize))
+        return;
+    entry.imageSize = imageSize;
+    entry.found = found && !points.empty();
+    if (entry.found)
+        entry.points = points;
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_[imagePath] = std::move(entry);
+    dirty_ = true;
+}
+
+bool CornerCache::save()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!dirty_)
+        return true;
+    std::ofstream out(path_, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+    {
+        std::cerr << "Cannot write corner cache " << path_ << std::endl;
+        return false;
+    }
+    CacheHeader header;
+    header.paramsHash = paramsHash_;
+    header.entryCount = entries_.size();
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const auto& item : entries_)
+    {
+        const Entry& entry = item.second;
+        RecordHeader record;
+        record.mtime = entry.mtime;
+        record.fileSize = entry.fileSize;
+        record.width = entry.imageSize.width;
+        record.height = entry.imageSize.height;
+        record.pathLength = static_cast<uint32_t>(item.first.size());
+        record.pointCount = static_cast<uint32_t>(entry.points.size());
+        out.write(reinterpret_cast<const char*>(&record), sizeof(record));
+        out.write(item.first.data(), item.first.size());
+        out.write(reinterpret_cast<const char*>(entry.points.data()),
+                  entry.points.size() * sizeof(cv::Point2f));
+    }
+    dirty_ = false;
+    return bool(out);
+}
+
+void CornerCache::printStats(std::ostream& os) const
+{
+    const uint64_t total = hits_ + misses_;
+    os << "Corner cache " << path_ << ": " << hits_ << " hits, " << misses_ << " misses";
+    if (total)
+        os << " (" << 100 * hits_ / total << "% hit rate)";
+    os << ", " << loaded_ << " entries loaded" << std::endl;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+// On-disk cache of pattern detections for image-list calibrations.
+//
+// Tuning the calibration flags means running the same dataset again and
+// again, and finding the pattern is most of the work. The cache stores, per
+// image, whether the pattern was found and the refined corners, keyed on
+// the image path and validated against its modification time and size.
+// The whole file is additionally keyed on a description of the detector
+// configuration (pattern, board size, cornerSubPix window, ...): if that
+// changes, every entry is discarded.
+//
+// The file is a small binary: a header followed by one record per image
+// holding the path, mtime, size, image size and the corners as float pairs.
+// It is read once in the constructor and written by save() if anything was
+// added. lookup() and store() may be called from several threads.
+class CornerCache
+{
+public:
+    CornerCache(const std::string& path, const std::string& detectorParams);
+
+    // True if `imagePath` has an entry that is still valid for the file on
+    // disk; `found`, `imageSize` and `points` are then filled from it.
+    bool lookup(const std::string& imagePath, bool& found, cv::Size& imageSize,
+                std::vector<cv::Point2f>& points);
+    void store(const std::string& imagePath, bool found, cv::Size imageSize,
+               const std::vector<cv::Point2f>& points);
+    // Writes the cache back if store() added or replaced entries.
+    bool save();
+
+    uint64_t hits() const { return hits_; }
+    uint64_t misses() const { return misses_; }
+    void printStats(std::ostream& os) const;
+
+private:
+    struct Entry
+    {
+        int64_t mtime = 0;  // nanoseconds since the epoch
+        uint64_t fileSize = 0;
+        cv::Size imageSize;
+        bool found = false;
+        std::vector<cv::Point2f> points;
+    };
+
+    void load();
+
+    const std::string path_;
+    const uint64_t paramsHash_;
+    std::map<std::string, Entry> entries_;
+    size_t loaded_ = 0;
+    bool dirty_ = false;
+    uint64_t hits_ = 0, misses_ = 0;
+    std::mutex mutex_;
+};
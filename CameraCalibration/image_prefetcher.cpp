@@ -0,0 +1,116 @@
+#include "image_prefetcher.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+
+#include <opencv2/imgcodecs.hpp>
+
+#include "common/profiler.h"
+
+namespace
+{
+typedef std::chrono::steady_clock Clock;
+
+double elapsedMs(Clock::time_point from)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - from).count();
+}
+}
+
+ImagePrefetcher::ImagePrefetcher(const std::vector<std::string>& paths, size_t first, size_t depth,
+                                 int threads, int imreadFlags)
+    : paths_(paths), imreadFlags_(imreadFlags), slots_(std::max<size_t>(depth, 1)),
+      nextToDecode_(first), nextToRead_(first)
+{
+    // More workers than slots would only wait for a free one
+    threads = std::max(1, std::min<int>(threads, (int)slots_.size()));
+    for (int t = 0; t < threads; ++t)
+        workers_.emplace_back(&ImagePrefetcher::workerLoop, this);
+}
+
+ImagePrefetcher::~ImagePrefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    slotFree_.notify_all();
+    for (std::thread& worker : workers_)
+        worker.join();
+}
+
+void ImagePrefetcher::workerLoop()
+{
+    Profiler::setThreadName("prefetch");
+    const size_t depth = slots_.size();
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;)
+    {
+        slotFree_.wait(lock, [&] {
+            return stopping_ || nextToDecode_ >= paths_.size() ||
+                   nextToDecode_ < nextToRead_ + depth;
+        });
+        if (stopping_ || nextToDecode_ >= paths_.size())
+            return;
+        const size_t index = nextToDecode_++;
+        lock.unlock();
+
+        Profiler::setFrame(index);
+        Clock::time_point start = Clock::now();
+        cv::Mat image;
+        {
+            PROFILE_SCOPE("calib/decode");
+            image = cv::imread(paths_[index], imreadFlags_);
+        }
+        const double decodeMs = elapsedMs(start);
+
+        lock.lock();
+        Slot& slot = slots_[index % depth];
+        slot.image = image;
+        slot.decodeMs = decodeMs;
+        slot.ready = true;
+        slotReady_.notify_all();
+    }
+}
+
+cv::Mat ImagePrefetcher::next()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (nextToRead_ >= paths_.size())
+        return cv::Mat();
+    Slot& slot = slots_[nextToRead_ % slots_.size()];
+    if (!slot.ready)
+    {
+        Clock::time_point start = Clock::now();
+        slotReady_.wait(lock, [&] { return slot.ready; });
+        stats_.waitMs += elapsedMs(start);
+        ++stats_.waits;
+    }
+    cv::Mat image = slot.image;
+    slot.image.release();  // the caller holds the only reference from here on
+    slot.ready = false;
+    ++stats_.images;
+    stats_.decodeMs += slot.decodeMs;
+    ++nextToRead_;
+    lock.unlock();
+    slotFree_.notify_all();
+    return image;
+}
+
+ImagePrefetcher::Stats ImagePrefetcher::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void ImagePrefetcher::printStats(std::ostream& os) const
+{
+    const Stats s = stats();
+    const double n = s.images ? (double)s.images : 1.0;
+    os << std::fixed << std::setprecision(2) << "Prefetch: " << s.images << " images, "
+       << workers_.size() << " threads, " << slots_.size() << " slots; decode " << s.decodeMs / n
+       << " ms/image, waited " << s.waitMs / n << " ms/image (" << s.waits << " of "
+       << s.images << " images not ready)" << std::endl;
+    os.unsetf(std::ios::floatfield);
+}
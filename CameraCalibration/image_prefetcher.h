@@ -0,0 +1,71 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+// Read-ahead decoder for an image list.
+//
+// Background threads decode the images following the one the caller is
+// working on, so disk reads and JPEG/PNG decoding overlap with the pattern
+// search instead of adding to it. At most `depth` decoded images are held
+// at once: a worker only starts on image i once the caller has taken image
+// i - depth, which keeps memory bounded however slow the consumer is.
+// Images come out of next() in list order regardless of which worker
+// decoded them.
+class ImagePrefetcher
+{
+public:
+    // Decodes paths[first..] with cv::imread(path, imreadFlags), e.g.
+    // IMREAD_GRAYSCALE when only the pattern search needs the pixels.
+    ImagePrefetcher(const std::vector<std::string>& paths, size_t first, size_t depth,
+                    int threads, int imreadFlags);
+    ~ImagePrefetcher();
+
+    ImagePrefetcher(const ImagePrefetcher&) = delete;
+    ImagePrefetcher& operator=(const ImagePrefetcher&) = delete;
+
+    // The next image in list order, waiting for it if it is not decoded yet.
+    // Empty at the end of the list or when imread() failed, like imread().
+    cv::Mat next();
+
+    struct Stats
+    {
+        uint64_t images = 0;
+        double decodeMs = 0;  // summed over all workers
+        double waitMs = 0;    // time next() spent blocked
+        uint64_t waits = 0;   // calls to next() that had to block
+    };
+    Stats stats() const;
+    void printStats(std::ostream& os) const;
+
+private:
+    struct Slot
+    {
+        cv::Mat image;
+        double decodeMs = 0;
+        bool ready = false;
+    };
+
+    void workerLoop();
+
+    const std::vector<std::string> paths_;
+    const int imreadFlags_;
+    std::vector<Slot> slots_;  // image i lives in slots_[i % depth]
+
+    mutable std::mutex mutex_;
+    std::condition_variable slotFree_;
+    std::condition_variable slotReady_;
+    size_t nextToDecode_;
+    size_t nextToRead_;
+    bool stopping_ = false;
+    Stats stats_;
+
+    std::vector<std::thread> workers_;
+};
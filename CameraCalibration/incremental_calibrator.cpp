@@ -0,0 +1,150 @@
+#include "incremental_calibrator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include <opencv2/calib3d.hpp>
+
+#include "common/profiler.h"
+
+IncrementalCalibrator::IncrementalCalibrator(const std::vector<cv::Point3f>& objectPoints,
+                                             cv::Size imageSize, int flags, bool fisheye,
+                                             float aspectRatio, int fixedPoint, double tolerance)
+    : objectPoints_(objectPoints), imageSize_(imageSize), flags_(flags), fisheye_(fisheye),
+      aspectRatio_(aspectRatio), fixedPoint_(fixedPoint), tolerance_(tolerance)
+{
+    thread_ = std::thread(&IncrementalCalibrator::solverLoop, this);
+}
+
+IncrementalCalibrator::~IncrementalCalibrator()
+{
+    stop();
+    thread_.join();
+}
+
+void IncrementalCalibrator::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+}
+
+void IncrementalCalibrator::addView(const std::vector<cv::Point2f>& imagePoints)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        views_.push_back(imagePoints);
+    }
+    wake_.notify_all();
+}
+
+IncrementalResult IncrementalCalibrator::result() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return result_;
+}
+
+bool IncrementalCalibrator::stable() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return tolerance_ > 0 && result_.stableUpdates >= kStableUpdates;
+}
+
+void IncrementalCalibrator::solverLoop()
+{
+    Profiler::setThreadName("calibrate");
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;)
+    {
+        wake_.wait(lock, [&] {
+            return stopping_ || (views_.size() > solvedViews_ && views_.size() >= kMinViews);
+        });
+        if (stopping_)
+            return;
+        // Solve on a copy so the capture loop can keep adding views
+        const std::vector<std::vector<cv::Point2f> > views = views_;
+        solvedViews_ = views.size();
+        lock.unlock();
+        solve(views);
+        lock.lock();
+    }
+}
+
+void IncrementalCalibrator::solve(const std::vector<std::vector<cv::Point2f> >& views)
+{
+    PROFILE_SCOPE("calib/incremental");
+    IncrementalResult previous = result();
+    cv::Mat K, D;
+    int flags = flags_;
+    if (previous.updates > 0)
+    {
+        // Warm start: only the new views' contribution is left to fit
+        K = previous.cameraMatrix.clone();
+        D = previous.distCoeffs.clone();
+        if (fisheye_)
+            flags |= cv::fisheye::CALIB_USE_INTRINSIC_GUESS;
+        else
+            flags |= cv::CALIB_USE_INTRINSIC_GUESS;
+    }
+    else
+    {
+        // Same starting point as runCalibration
+        K = cv::Mat::eye(3, 3, CV_64F);
+        if (!fisheye_ && (flags_ & cv::CALIB_FIX_ASPECT_RATIO))
+            K.at<double>(0, 0) = aspectRatio_;
+        D = cv::Mat::zeros(fisheye_ ? 4 : 8, 1, CV_64F);
+    }
+
+    const std::vector<std::vector<cv::Point3f> > objectPoints(views.size(), objectPoints_);
+    std::vector<cv::Mat> rvecs, tvecs;
+    std::vector<cv::Point3f> newObjectPoints;
+    cv::Mat stdDevIntrinsics, stdDevExtrinsics, stdDevObjectPoints, perViewErrors;
+    // Looser than the final calibration: the next view refines the result anyway
+    const cv::TermCriteria criteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 30, 1e-6);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double rms;
+    try
+    {
+        if (fisheye_)
+            rms = cv::fisheye::calibrate(objectPoints, views, imageSize_, K, D, rvecs, tvecs, flags,
+                                         criteria);
+        else
+            // Same solver as runCalibration; with fixedPoint -1 it is plain calibrateCamera
+            rms = cv::calibrateCameraRO(objectPoints, views, imageSize_, fixedPoint_, K, D, rvecs,
+                                        tvecs, newObjectPoints, stdDevIntrinsics, stdDevExtrinsics,
+                                        stdDevObjectPoints, perViewErrors, flags | cv::CALIB_USE_LU,
+                                        criteria);
+    }
+    catch (const cv::Exception&)
+    {
+        // Degenerate view set (e.g. all views parallel); wait for more views
+        return;
+    }
+    const double solveMs =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    IncrementalResult& r = result_;
+    r.change = 0;
+    if (r.updates > 0)
+    {
+        const int params[4][2] = {{0, 0}, {1, 1}, {0, 2}, {1, 2}};  // fx, fy, cx, cy
+        for (const auto& p : params)
+        {
+            const double before = r.cameraMatrix.at<double>(p[0], p[1]);
+            const double after = K.at<double>(p[0], p[1]);
+            r.change = std::max(r.change, std::abs(after - before) / std::max(1e-9, std::abs(after)));
+        }
+        r.stableUpdates = r.change < tolerance_ ? r.stableUpdates + 1 : 0;
+    }
+    ++r.updates;
+    r.views = views.size();
+    r.rms = rms;
+    r.solveMs = solveMs;
+    r.cameraMatrix = K;
+    r.distCoeffs = D;
+    r.stdDevIntrinsics = stdDevIntrinsics;
+}
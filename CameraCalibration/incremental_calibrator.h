@@ -0,0 +1,88 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+// Latest state of an incremental calibration.
+struct IncrementalResult
+{
+    uint64_t updates = 0;  // solves finished so far
+    size_t views = 0;      // views the latest solve used
+    double rms = 0;
+    double solveMs = 0;
+    cv::Mat cameraMatrix, distCoeffs;
+    // Standard deviations of fx, fy, cx, cy, k1, k2, p1, p2, k3, ... as the
+    // extended calibrateCameraRO() estimates them; empty for the fisheye model
+    cv::Mat stdDevIntrinsics;
+    // Largest relative change of fx, fy, cx or cy against the previous solve
+    double change = 0;
+    // Consecutive solves whose change stayed under the tolerance
+    int stableUpdates = 0;
+};
+
+// Re-solves the calibration on a background thread while views are being
+// captured.
+//
+// Every addView() wakes the solver thread, which calibrates with all views
+// so far. After the first solve, each one starts from the previous
+// intrinsics (CALIB_USE_INTRINSIC_GUESS), so it only has to correct them
+// for the new views and converges in a few iterations. Views that arrive
+// during a solve are picked up together by the next one. The capture loop
+// reads result() to show the converging error and parameter uncertainty,
+// and stable() to stop once the intrinsics no longer move.
+class IncrementalCalibrator
+{
+public:
+    // `objectPoints` is the board model shared by all views; `flags` are
+    // calibrateCamera (or fisheye::calibrate) flags. `fixedPoint` is the
+    // calibrateCameraRO fixed point, -1 for a rigid board, so the solves
+    // fit the same model as the final calibration. A solve counts as
+    // stable if fx, fy, cx and cy changed by less than `tolerance`
+    // (relative); tolerance 0 never reports stable.
+    IncrementalCalibrator(const std::vector<cv::Point3f>& objectPoints, cv::Size imageSize,
+                          int flags, bool fisheye, float aspectRatio, int fixedPoint,
+                          double tolerance);
+    // Waits for a solve that is still running; call stop() first to let
+    // it finish in the background instead
+    ~IncrementalCalibrator();
+
+    IncrementalCalibrator(const IncrementalCalibrator&) = delete;
+    IncrementalCalibrator& operator=(const IncrementalCalibrator&) = delete;
+
+    void addView(const std::vector<cv::Point2f>& imagePoints);
+    // Starts no further solves; returns without waiting for the current one
+    void stop();
+    IncrementalResult result() const;
+    bool stable() const;
+
+    // Solves before the parameters count as stable
+    static const int kStableUpdates = 3;
+    // Fewer views do not constrain the intrinsics enough to start from
+    static const size_t kMinViews = 3;
+
+private:
+    void solverLoop();
+    void solve(const std::vector<std::vector<cv::Point2f> >& views);
+
+    const std::vector<cv::Point3f> objectPoints_;
+    const cv::Size imageSize_;
+    const int flags_;
+    const bool fisheye_;
+    const float aspectRatio_;
+    const int fixedPoint_;
+    const double tolerance_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::vector<std::vector<cv::Point2f> > views_;
+    size_t solvedViews_ = 0;
+    bool stopping_ = false;
+    IncrementalResult result_;
+
+    std::thread thread_;
+};
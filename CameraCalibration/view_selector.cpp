@@ -0,0 +1,184 @@
+#include "view_selector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <set>
+
+namespace
+{
+// Pose differences that make two views clearly different: a quarter of the
+// image in position, a tenth in apparent size, ~15% foreshortening in tilt
+const double kPositionScale = 0.25;
+const double kSizeScale = 0.1;
+const double kTiltScale = 0.15;
+
+double edge(const cv::Point2f& a, const cv::Point2f& b)
+{
+    return std::max(1e-6, (double)cv::norm(a - b));
+}
+}
+
+ViewSelector::ViewSelector(cv::Size imageSize, cv::Size patternSize, double minGain, cv::Size grid)
+    : imageSize_(imageSize), patternSize_(patternSize), grid_(grid), minGain_(minGain),
+      counts_(grid.area(), 0)
+{
+}
+
+int ViewSelector::cell(const cv::Point2f& p) const
+{
+    const int cx = std::min(grid_.width - 1, std::max(0, (int)(p.x * grid_.width / imageSize_.width)));
+    const int cy = std::min(grid_.height - 1, std::max(0, (int)(p.y * grid_.height / imageSize_.height)));
+    return cy * grid_.width + cx;
+}
+
+ViewSelector::Pose ViewSelector::pose(const std::vector<cv::Point2f>& corners) const
+{
+    Pose pose = {0.5, 0.5, 0.0, 0.0, 0.0};
+    if (corners.empty())
+        return pose;
+    cv::Point2f tl, tr, bl, br;
+    if ((int)corners.size() == patternSize_.area())
+    {
+        tl = corners[0];
+        tr = corners[patternSize_.width - 1];
+        bl = corners[(patternSize_.height - 1) * patternSize_.width];
+        br = corners.back();
+    }
+    else
+    {
+        // Partial board: only the bounding box is meaningful
+        const cv::Rect box = cv::boundingRect(corners);
+        tl = cv::Point2f((float)box.x, (float)box.y);
+        br = cv::Point2f((float)(box.x + box.width), (float)(box.y + box.height));
+        tr = cv::Point2f(br.x, tl.y);
+        bl = cv::Point2f(tl.x, br.y);
+    }
+    const cv::Point2f centre = (tl + tr + bl + br) * 0.25f;
+    // Shoelace formula over tl, tr, br, bl
+    const double area = 0.5 * std::abs((tl.x * tr.y - tr.x * tl.y) + (tr.x * br.y - br.x * tr.y) +
+                                       (br.x * bl.y - bl.x * br.y) + (bl.x * tl.y - tl.x * bl.y));
+    pose.x = centre.x / imageSize_.width;
+    pose.y = centre.y / imageSize_.height;
+    pose.size = std::sqrt(area / imageSize_.area());
+    pose.tiltX = std::log(edge(tl, bl) / edge(tr, br));
+    pose.tiltY = std::log(edge(tl, tr) / edge(bl, br));
+    return pose;
+}
+
+double ViewSelector::poseDistance(const Pose& p) const
+{
+    double nearest = 1.0;  // capped: beyond that a view is simply "new"
+    for (const Pose& q : poses_)
+    {
+        const double dx = (p.x - q.x) / kPositionScale, dy = (p.y - q.y) / kPositionScale;
+        const double ds = (p.size - q.size) / kSizeScale;
+        const double dtx = (p.tiltX - q.tiltX) / kTiltScale, dty = (p.tiltY - q.tiltY) / kTiltScale;
+        nearest = std::min(nearest, std::sqrt(dx * dx + dy * dy + ds * ds + dtx * dtx + dty * dty));
+    }
+    return nearest;
+}
+
+double ViewSelector::gain(const std::vector<cv::Point2f>& corners) const
+{
+    if (corners.empty())
+        return 0.0;
+    std::set<int> cells;
+    for (const cv::Point2f& p : corners)
+        cells.insert(cell(p));
+    size_t fresh = 0;
+    for (int c : cells)
+        fresh += counts_[c] == 0;
+    const double coverageGain = (double)fresh / cells.size();
+    return 0.5 * coverageGain + 0.5 * poseDistance(pose(corners));
+}
+
+void ViewSelector::add(const std::vector<cv::Point2f>& corners)
+{
+    for (const cv::Point2f& p : corners)
+        ++counts_[cell(p)];
+    poses_.push_back(pose(corners));
+}
+
+bool ViewSelector::consider(const std::vector<cv::Point2f>& corners)
+{
+    if (gain(corners) < minGain_)
+        return false;
+    add(corners);
+    return true;
+}
+
+std::vector<size_t> ViewSelector::select(const std::vector<std::vector<cv::Point2f> >& candidates,
+                                         size_t maxViews)
+{
+    std::vector<size_t> chosen;
+    std::vector<bool> taken(candidates.size(), false);
+    while (chosen.size() < maxViews)
+    {
+        double bestGain = -1.0;
+        size_t best = 0;
+        for (size_t i = 0; i < candidates.size(); ++i)
+        {
+            if (taken[i])
+                continue;
+            const double g = gain(candidates[i]);
+            if (g > bestGain)  // ties keep the earlier view, so the result is deterministic
+            {
+                bestGain = g;
+                best = i;
+            }
+        }
+        if (bestGain < 0.0 || bestGain < minGain_)  // none left, or none worth it
+            break;
+        taken[best] = true;
+        chosen.push_back(best);
+        add(candidates[best]);
+    }
+    return chosen;
+}
+
+double ViewSelector::coverage() const
+{
+    const size_t covered = counts_.size() - std::count(counts_.begin(), counts_.end(), 0);
+    return (double)covered / counts_.size();
+}
+
+void ViewSelector::printCoverage(std::ostream& os) const
+{
+    static const char kShades[] = " .:-=+*#%@";
+    const int maxCount = std::max(1, *std::max_element(counts_.begin(), counts_.end()));
+    os << "Corner coverage of " << poses_.size() << " views (" << grid_.width << "x" << grid_.height
+       << " cells, ' ' none to '@' " << maxCount << " corners):" << std::endl;
+    const std::string border = "+" + std::string(grid_.width * 2, '-') + "+";
+    os << border << std::endl;
+    for (int y = 0; y < grid_.height; ++y)
+    {
+        os << "|";
+        for (int x = 0; x < grid_.width; ++x)
+        {
+            const int count = counts_[y * grid_.width + x];
+            const int shade = count == 0 ? 0 : 1 + std::min(8, (count - 1) * 9 / maxCount);
+            os << kShades[shade] << kShades[shade];
+        }
+        os << "|" << std::endl;
+    }
+    os << border << std::endl;
+
+    if (poses_.empty())
+        return;
+    double sizeMin = 1e9, sizeMax = -1e9, tiltXMin = 1e9, tiltXMax = -1e9, tiltYMin = 1e9,
+           tiltYMax = -1e9;
+    for (const Pose& p : poses_)
+    {
+        sizeMin = std::min(sizeMin, p.size);
+        sizeMax = std::max(sizeMax, p.size);
+        tiltXMin = std::min(tiltXMin, p.tiltX);
+        tiltXMax = std::max(tiltXMax, p.tiltX);
+        tiltYMin = std::min(tiltYMin, p.tiltY);
+        tiltYMax = std::max(tiltYMax, p.tiltY);
+    }
+    os << std::fixed << std::setprecision(2) << "cells covered " << 100.0 * coverage()
+       << "%, board size " << sizeMin << ".." << sizeMax << " of the image, tilt (log edge ratio) x "
+       << tiltXMin << ".." << tiltXMax << ", y " << tiltYMin << ".." << tiltYMax << std::endl;
+    os.unsetf(std::ios::floatfield);
+}
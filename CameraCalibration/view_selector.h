@@ -0,0 +1,66 @@
+#pragma once
+
+#include <ostream>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+// Picks the calibration views that add information.
+//
+// calibrateCamera's cost grows with the number of views, but a view of the
+// board in the same place, at the same distance and tilt as one already
+// taken adds next to nothing to the solution. Each view is described by
+// where its corners fall on a coarse grid over the image, and by a pose
+// signature computed from the outer corners alone (no calibration needed
+// yet): board centre, apparent size (distance), and the foreshortening of
+// opposite edges (tilt about either axis). A view's gain is the fraction
+// of grid cells it covers for the first time plus its distance in pose
+// space to the nearest view already kept; views below `minGain` are
+// dropped.
+class ViewSelector
+{
+public:
+    // `patternSize` is the corner grid of one view, row-major as the
+    // detectors return it.
+    ViewSelector(cv::Size imageSize, cv::Size patternSize, double minGain,
+                 cv::Size grid = cv::Size(16, 9));
+
+    // Gain `corners` would bring over the views kept so far.
+    double gain(const std::vector<cv::Point2f>& corners) const;
+    // Online selection for live capture: keeps the view if its gain is at
+    // least minGain and returns whether it did.
+    bool consider(const std::vector<cv::Point2f>& corners);
+    // Keeps a view unconditionally, e.g. to report on a fixed set.
+    void add(const std::vector<cv::Point2f>& corners);
+
+    // Offline selection: greedily takes the candidate with the highest gain
+    // until `maxViews` are kept or no candidate reaches minGain. Returns the
+    // indices of the chosen candidates, most informative first.
+    std::vector<size_t> select(const std::vector<std::vector<cv::Point2f> >& candidates,
+                               size_t maxViews);
+
+    size_t views() const { return poses_.size(); }
+    double minGain() const { return minGain_; }
+    // Fraction of grid cells at least one corner fell into
+    double coverage() const;
+    // Corner density per grid cell as text, plus the ranges of distance and
+    // tilt the kept views span.
+    void printCoverage(std::ostream& os) const;
+
+private:
+    struct Pose
+    {
+        double x, y;          // board centre, 0..1 of the image
+        double size;          // sqrt of board area over image area
+        double tiltX, tiltY;  // log ratio of opposite edge lengths
+    };
+
+    Pose pose(const std::vector<cv::Point2f>& corners) const;
+    int cell(const cv::Point2f& p) const;
+    double poseDistance(const Pose& pose) const;
+
+    cv::Size imageSize_, patternSize_, grid_;
+    double minGain_;
+    std::vector<int> counts_;  // corners per grid cell
+    std::vector<Pose> poses_;
+};
@@ -0,0 +1,235 @@
+#include "profiler.h"
+
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+std::atomic<ProfileZone *> zones[Profiler::kMaxZones];
+std::atomic<int> zonesRegistered{0};
+
+double nsToMs(int64_t ns) { return ns * 1e-6; }
+
+struct TraceEvent {
+  const char *name;
+  int64_t startNs; // since traceEpoch
+  int64_t durationNs;
+  uint64_t frame;
+};
+
+// Events of one thread. Only that thread appends; writeTrace() reads
+// `count` events once the thread is quiet.
+struct ThreadTrace {
+  int tid = 0;
+  std::string name;
+  std::vector<TraceEvent> events; // sized up front, never grows
+  std::atomic<size_t> count{0};
+  std::atomic<uint64_t> dropped{0};
+};
+
+std::mutex traceMutex; // guards threadTraces and traceCapacity
+std::vector<std::unique_ptr<ThreadTrace>> threadTraces;
+size_t traceCapacity = 0;
+std::chrono::high_resolution_clock::time_point traceEpoch;
+
+thread_local ThreadTrace *currentTrace = nullptr;
+thread_local const char *currentThreadName = nullptr;
+thread_local uint64_t currentFrame = 0;
+
+// First traced event on a thread: allocate its buffer
+ThreadTrace *threadTrace() {
+  if (currentTrace)
+    return currentTrace;
+  std::lock_guard<std::mutex> lock(traceMutex);
+  std::unique_ptr<ThreadTrace> trace(new ThreadTrace());
+  trace->tid = static_cast<int>(threadTraces.size()) + 1;
+  trace->name = currentThreadName
+                    ? currentThreadName
+                    : "thread " + std::to_string(trace->tid);
+  trace->events.resize(traceCapacity);
+  currentTrace = trace.get();
+  threadTraces.push_back(std::move(trace));
+  return currentTrace;
+}
+
+// Zone names are "stage/step"; the stage becomes the event category
+void writeCategory(std::ostream &os, const char *name) {
+  const char *slash = std::strchr(name, '/');
+  if (slash)
+    os.write(name, slash - name);
+  else
+    os << name;
+}
+} // namespace
+
+std::atomic<bool> Profiler::enabled_{false};
+std::atomic<bool> Profiler::tracing_{false};
+
+ProfileZone::ProfileZone(const char *name) : name_(name) {
+  Profiler::registerZone(this);
+}
+
+void ProfileZone::record(int64_t ns) {
+  calls_.fetch_add(1, std::memory_order_relaxed);
+  totalNs_.fetch_add(ns, std::memory_order_relaxed);
+  lastNs_.store(ns, std::memory_order_relaxed);
+  int64_t max = maxNs_.load(std::memory_order_relaxed);
+  while (ns > max &&
+         !maxNs_.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+  }
+}
+
+double ProfileZone::totalMs() const {
+  return nsToMs(totalNs_.load(std::memory_order_relaxed));
+}
+
+double ProfileZone::avgMs() const {
+  const uint64_t n = calls();
+  return n ? totalMs() / n : 0.0;
+}
+
+double ProfileZone::maxMs() const {
+  return nsToMs(maxNs_.load(std::memory_order_relaxed));
+}
+
+double ProfileZone::lastMs() const {
+  return nsToMs(lastNs_.load(std::memory_order_relaxed));
+}
+
+void Profiler::setEnabled(bool enabled) {
+  enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+// Zones beyond kMaxZones still time (and feed output pointers) but are left
+// out of the report.
+void Profiler::registerZone(ProfileZone *zone) {
+  const int i = zonesRegistered.fetch_add(1, std::memory_order_relaxed);
+  if (i < kMaxZones)
+    zones[i].store(zone, std::memory_order_release);
+}
+
+int Profiler::zoneCount() {
+  const int n = zonesRegistered.load(std::memory_order_acquire);
+  return n < kMaxZones ? n : kMaxZones;
+}
+
+const ProfileZone *Profiler::zone(int i) {
+  return zones[i].load(std::memory_order_acquire);
+}
+
+void Profiler::printReport(std::ostream &os) {
+  os << "Profile (ms):\n"
+     << std::left << std::setw(28) << "  zone" << std::right << std::setw(10)
+     << "calls" << std::setw(10) << "avg" << std::setw(10) << "max"
+     << std::setw(12) << "total"
+     << "\n";
+  const auto flags = os.flags();
+  const auto precision = os.precision();
+  os << std::fixed << std::setprecision(3);
+  for (int i = 0; i < zoneCount(); ++i) {
+    const ProfileZone *z = zone(i);
+    if (!z || z->calls() == 0)
+      continue;
+    os << "  " << std::left << std::setw(26) << z->name() << std::right
+       << std::setw(10) << z->calls() << std::setw(10) << z->avgMs()
+       << std::setw(10) << z->maxMs() << std::setw(12) << z->totalMs()
+       << "\n";
+  }
+  os.flags(flags);
+  os.precision(precision);
+}
+
+void Profiler::startTrace(size_t eventsPerThread) {
+  std::lock_guard<std::mutex> lock(traceMutex);
+  traceCapacity = eventsPerThread;
+  traceEpoch = std::chrono::high_resolution_clock::now();
+  tracing_.store(true, std::memory_order_relaxed);
+}
+
+void Profiler::setThreadName(const char *name) {
+  currentThreadName = name;
+  if (currentTrace) {
+    std::lock_guard<std::mutex> lock(traceMutex);
+    currentTrace->name = name;
+  }
+}
+
+void Profiler::setFrame(uint64_t frame) { currentFrame = frame; }
+
+void Profiler::traceEvent(const ProfileZone &zone,
+                          std::chrono::high_resolution_clock::time_point start,
+                          int64_t durationNs) {
+  ThreadTrace *trace = threadTrace();
+  const size_t i = trace->count.load(std::memory_order_relaxed);
+  if (i >= trace->events.size()) {
+    trace->dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  TraceEvent &event = trace->events[i];
+  event.name = zone.name();
+  event.startNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      start - traceEpoch)
+                      .count();
+  event.durationNs = durationNs;
+  event.frame = currentFrame;
+  trace->count.store(i + 1, std::memory_order_release);
+}
+
+bool Profiler::writeTrace(const std::string &path) {
+  std::ofstream os(path);
+  if (!os.is_open()) {
+    std::cerr << "Failed to open trace file: " << path << "\n";
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(traceMutex);
+  uint64_t events = 0, dropped = 0;
+  os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  os << std::fixed << std::setprecision(3);
+  bool first = true;
+  for (const std::unique_ptr<ThreadTrace> &trace : threadTraces) {
+    os << (first ? "" : ",\n")
+       << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+       << trace->tid << ",\"args\":{\"name\":\"" << trace->name << "\"}}";
+    first = false;
+    const size_t count = trace->count.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count; ++i) {
+      const TraceEvent &e = trace->events[i];
+      // Complete events ("X"): begin and duration in microseconds
+      os << ",\n{\"name\":\"" << e.name << "\",\"cat\":\"";
+      writeCategory(os, e.name);
+      os << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << trace->tid
+         << ",\"ts\":" << e.startNs * 1e-3 << ",\"dur\":"
+         << e.durationNs * 1e-3 << ",\"args\":{\"frame\":" << e.frame
+         << "}}";
+    }
+    events += count;
+    dropped += trace->dropped;
+  }
+  os << "\n]}\n";
+
+  std::cout << "Wrote " << events << " trace events to " << path << "\n";
+  if (dropped)
+    std::cerr << dropped << " trace events did not fit the per-thread "
+              << "buffers and were dropped\n";
+  return os.good();
+}
+
+void ScopedTimer::stop() {
+  if (!active_)
+    return;
+  active_ = false;
+  const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         Clock::now() - start_)
+                         .count();
+  if (Profiler::enabled())
+    zone_.record(ns);
+  if (Profiler::tracing())
+    Profiler::traceEvent(zone_, start_, ns);
+  if (outMs_)
+    *outMs_ = ns * 1e-6;
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Scoped-timer instrumentation shared by AR and CameraCalibration.
+//
+// A ProfileZone accumulates the durations measured for one named stage
+// (calls, total, maximum, last). ScopedTimer measures from its construction
+// to stop() or the end of the scope. Zones register themselves in a
+// fixed-size table the first time they are constructed, so
+// Profiler::printReport() can list every stage that ran.
+//
+// Recording is off until Profiler::setEnabled(true). While it is off a
+// ScopedTimer costs one relaxed atomic load. Building with
+// -DPROFILING_DISABLED turns even that into a constant. A timer given an
+// output pointer always measures, because its caller needs the number (the
+// per-frame telemetry record, for instance).
+//
+// Independently of the report, Profiler::startTrace() makes every timer
+// also log a begin/duration event into a buffer owned by its thread. The
+// buffers are preallocated, filled without locks and only turned into a
+// Chrome trace-event JSON file (chrome://tracing, ui.perfetto.dev) by
+// writeTrace(), so tracing adds no I/O while the program runs.
+class ProfileZone {
+public:
+  explicit ProfileZone(const char *name);
+  ProfileZone(const ProfileZone &) = delete;
+  ProfileZone &operator=(const ProfileZone &) = delete;
+
+  const char *name() const { return name_; }
+  void record(int64_t ns);
+
+  uint64_t calls() const { return calls_.load(std::memory_order_relaxed); }
+  double totalMs() const;
+  double avgMs() const;
+  double maxMs() const;
+  double lastMs() const;
+
+private:
+  const char *name_;
+  std::atomic<uint64_t> calls_{0};
+  std::atomic<int64_t> totalNs_{0};
+  std::atomic<int64_t> maxNs_{0};
+  std::atomic<int64_t> lastNs_{0};
+};
+
+class Profiler {
+public:
+  static const int kMaxZones = 128;
+
+#ifdef PROFILING_DISABLED
+  static bool enabled() { return false; }
+  static bool tracing() { return false; }
+#else
+  static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+  static bool tracing() { return tracing_.load(std::memory_order_relaxed); }
+#endif
+  static void setEnabled(bool enabled);
+
+  // Starts collecting trace events, keeping at most `eventsPerThread` per
+  // thread (later ones are counted and dropped).
+  static void startTrace(size_t eventsPerThread = 1 << 18);
+  // Writes everything collected so far as Chrome trace JSON. Call once the
+  // traced threads are idle or joined. Returns false if the file cannot be
+  // written.
+  static bool writeTrace(const std::string &path);
+  // Label for the calling thread in the trace viewer.
+  static void setThreadName(const char *name);
+  // Tags the calling thread's following events with a frame number.
+  static void setFrame(uint64_t frame);
+
+  // Zones in registration order. zone(i) may be null for a moment while
+  // another thread is registering slot i.
+  static int zoneCount();
+  static const ProfileZone *zone(int i);
+
+  // One line per zone that recorded anything: calls, average, maximum and
+  // total time.
+  static void printReport(std::ostream &os);
+
+private:
+  friend class ProfileZone;
+  friend class ScopedTimer;
+  static void registerZone(ProfileZone *zone);
+  static void traceEvent(const ProfileZone &zone,
+                         std::chrono::high_resolution_clock::time_point start,
+                         int64_t durationNs);
+
+  static std::atomic<bool> enabled_;
+  static std::atomic<bool> tracing_;
+};
+
+class ScopedTimer {
+public:
+  using Clock = std::chrono::high_resolution_clock;
+
+  explicit ScopedTimer(ProfileZone &zone, double *outMs = nullptr)
+      : zone_(zone), outMs_(outMs),
+        active_(outMs != nullptr || Profiler::enabled() ||
+                Profiler::tracing()) {
+    if (active_)
+      start_ = Clock::now();
+  }
+  ~ScopedTimer() { stop(); }
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+  // Ends the measurement before the end of the scope; later calls do
+  // nothing.
+  void stop();
+
+private:
+  ProfileZone &zone_;
+  double *outMs_;
+  bool active_;
+  Clock::time_point start_;
+};
+
+#define PROFILE_JOIN_(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN_(a, b)
+
+// Times the rest of the enclosing scope as zone `name` (a string literal).
+#define PROFILE_SCOPE(name)                                                    \
+  static ProfileZone PROFILE_JOIN(profileZone_, __LINE__)(name);               \
+  ScopedTimer PROFILE_JOIN(profileTimer_, __LINE__)(                           \
+      PROFILE_JOIN(profileZone_, __LINE__))
+
+// Same, and also stores the duration in milliseconds in *outMs.
+#define PROFILE_SCOPE_MS(name, outMs)                                          \
+  static ProfileZone PROFILE_JOIN(profileZone_, __LINE__)(name);               \
+  ScopedTimer PROFILE_JOIN(profileTimer_, __LINE__)(                           \
+      PROFILE_JOIN(profileZone_, __LINE__), outMs)
+
+// Declares a timer `var` for zone `name` that the caller ends with
+// var.stop(), for stages that do not map onto a C++ scope.
+#define PROFILE_TIMER(var, name)                                               \
+  static ProfileZone PROFILE_JOIN(profileZone_, __LINE__)(name);               \
+  ScopedTimer var(PROFILE_JOIN(profileZone_, __LINE__))
+
+#define PROFILE_TIMER_MS(var, name, outMs)                                     \
+  static ProfileZone PROFILE_JOIN(profileZone_, __LINE__)(name);               \
+  ScopedTimer var(PROFILE_JOIN(profileZone_, __LINE__), outMs)
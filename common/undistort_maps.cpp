@@ -0,0 +1,138 @@
+#include "undistort_maps.h"
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <chrono>
+#include <iomanip>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+double elapsedMs(Clock::time_point from) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - from)
+      .count();
+}
+
+bool sameMat(const cv::Mat &a, const cv::Mat &b) {
+  if (a.size() != b.size() || a.type() != b.type())
+    return false;
+  return a.empty() || cv::norm(a, b, cv::NORM_INF) == 0.0;
+}
+
+double megabytes(size_t bytes) { return bytes / (1024.0 * 1024.0); }
+
+void printRow(const char *name, double ms, double mapMb, std::ostream &os) {
+  os << std::left << std::setw(14) << name << std::right << std::fixed
+     << std::setprecision(3) << std::setw(10) << ms << std::setprecision(1)
+     << std::setw(10) << (ms > 0.0 ? 1000.0 / ms : 0.0) << std::setw(10);
+  if (mapMb > 0.0)
+    os << std::setprecision(2) << mapMb;
+  else
+    os << "-";
+  os << "\n";
+}
+} // namespace
+
+bool UndistortMaps::update(const cv::Mat &cameraMatrix,
+                           const cv::Mat &distCoeffs, cv::Size size,
+                           bool fisheye, double alpha) {
+  if (!empty() && size == size_ && fisheye == fisheye_ && alpha == alpha_ &&
+      sameMat(cameraMatrix, cameraMatrix_) &&
+      sameMat(distCoeffs, distCoeffs_))
+    return false;
+
+  auto t_start = Clock::now();
+  // Copies: calibrateCamera() writes its results into the caller's buffers
+  cameraMatrix_ = cameraMatrix.clone();
+  distCoeffs_ = distCoeffs.clone();
+  size_ = size;
+  fisheye_ = fisheye;
+  alpha_ = alpha;
+
+  if (fisheye) {
+    if (alpha < 0.0)
+      newCameraMatrix_ = cameraMatrix_.clone();
+    else
+      cv::fisheye::estimateNewCameraMatrixForUndistortRectify(
+          cameraMatrix_, distCoeffs_, size, cv::Matx33d::eye(),
+          newCameraMatrix_, alpha);
+    cv::fisheye::initUndistortRectifyMap(cameraMatrix_, distCoeffs_,
+                                         cv::Matx33d::eye(), newCameraMatrix_,
+                                         size, CV_16SC2, map1_, map2_);
+  } else {
+    newCameraMatrix_ =
+        alpha < 0.0 ? cameraMatrix_.clone()
+                    : cv::getOptimalNewCameraMatrix(cameraMatrix_, distCoeffs_,
+                                                    size, alpha, size, 0);
+    cv::initUndistortRectifyMap(cameraMatrix_, distCoeffs_, cv::Mat(),
+                                newCameraMatrix_, size, CV_16SC2, map1_,
+                                map2_);
+  }
+  buildMs_ = elapsedMs(t_start);
+  return true;
+}
+
+void UndistortMaps::apply(const cv::Mat &src, cv::Mat &dst) const {
+  cv::remap(src, dst, map1_, map2_, cv::INTER_LINEAR);
+}
+
+void benchmarkUndistortion(const cv::Mat &frame, const cv::Mat &cameraMatrix,
+                           const cv::Mat &distCoeffs, bool fisheye,
+                           int iterations, std::ostream &os) {
+  if (frame.empty() || iterations <= 0)
+    return;
+  // Same view as the per-frame call: cv::undistort() keeps the camera
+  // matrix, fisheye::undistortImage() is given the balance-1 one
+  UndistortMaps maps;
+  maps.update(cameraMatrix, distCoeffs, frame.size(), fisheye,
+              fisheye ? 1.0 : -1.0);
+  const cv::Mat &newK = maps.newCameraMatrix();
+
+  cv::Mat floatX, floatY;
+  if (fisheye)
+    cv::fisheye::initUndistortRectifyMap(cameraMatrix, distCoeffs,
+                                         cv::Matx33d::eye(), newK,
+                                         frame.size(), CV_32FC1, floatX,
+                                         floatY);
+  else
+    cv::initUndistortRectifyMap(cameraMatrix, distCoeffs, cv::Mat(), newK,
+                                frame.size(), CV_32FC1, floatX, floatY);
+
+  cv::Mat perFrame, remapped;
+  auto t_start = Clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    if (fisheye)
+      cv::fisheye::undistortImage(frame, perFrame, cameraMatrix, distCoeffs,
+                                  newK);
+    else
+      cv::undistort(frame, perFrame, cameraMatrix, distCoeffs);
+  }
+  const double undistortMs = elapsedMs(t_start) / iterations;
+
+  t_start = Clock::now();
+  for (int i = 0; i < iterations; ++i)
+    cv::remap(frame, remapped, floatX, floatY, cv::INTER_LINEAR);
+  const double floatMs = elapsedMs(t_start) / iterations;
+
+  t_start = Clock::now();
+  for (int i = 0; i < iterations; ++i)
+    maps.apply(frame, remapped);
+  const double fixedMs = elapsedMs(t_start) / iterations;
+
+  const double maxDiff = cv::norm(perFrame, remapped, cv::NORM_INF);
+
+  os << "Undistortion of " << frame.cols << "x" << frame.rows << ", "
+     << iterations << " frames each\n"
+     << std::left << std::setw(14) << "method" << std::right << std::setw(10)
+     << "ms/frame" << std::setw(10) << "fps" << std::setw(10) << "map MB"
+     << "\n";
+  printRow(fisheye ? "undistortImage" : "undistort", undistortMs, 0.0, os);
+  printRow("remap float", floatMs,
+           megabytes(floatX.total() * floatX.elemSize() * 2), os);
+  printRow("remap fixed", fixedMs, megabytes(maps.bytes()), os);
+  os << std::setprecision(3) << "map build " << maps.buildMs()
+     << " ms once, fixed-point remap " << undistortMs / fixedMs
+     << "x the per-frame rate, largest pixel difference " << maxDiff << "\n";
+  os.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <ostream>
+
+// Lens undistortion through precomputed remap tables, shared by AR and
+// CameraCalibration.
+//
+// cv::undistort() and cv::fisheye::undistortImage() build the full
+// distortion map on every call and throw it away again. For a video stream
+// the map only depends on the calibration and the frame size, so it is
+// built once here, in the compact fixed-point form remap() is fastest with:
+// CV_16SC2 integer source coordinates plus a CV_16UC1 index into OpenCV's
+// bilinear interpolation table. That is 6 bytes per pixel instead of the 8
+// of two float maps.
+//
+// update() compares its arguments with those of the last build and only
+// rebuilds on a change, so callers can pass the current calibration every
+// frame.
+class UndistortMaps {
+public:
+  // `alpha` selects the camera matrix of the undistorted image: negative
+  // keeps `cameraMatrix`, like cv::undistort(); 0..1 is passed on as the
+  // alpha of getOptimalNewCameraMatrix() or, for the fisheye model, as the
+  // balance of estimateNewCameraMatrixForUndistortRectify(). Returns true
+  // if the maps were rebuilt.
+  bool update(const cv::Mat &cameraMatrix, const cv::Mat &distCoeffs,
+              cv::Size size, bool fisheye, double alpha);
+
+  bool empty() const { return map1_.empty(); }
+  cv::Size size() const { return size_; }
+  const cv::Mat &newCameraMatrix() const { return newCameraMatrix_; }
+  // Memory held by the two maps
+  size_t bytes() const {
+    return map1_.total() * map1_.elemSize() + map2_.total() * map2_.elemSize();
+  }
+  // Time the last rebuild took
+  double buildMs() const { return buildMs_; }
+
+  // Bilinear remap of a frame of size(). `dst` must not share data with
+  // `src`; its buffer is reused when it already has the right shape.
+  void apply(const cv::Mat &src, cv::Mat &dst) const;
+
+private:
+  cv::Mat cameraMatrix_, distCoeffs_;
+  cv::Size size_;
+  bool fisheye_ = false;
+  double alpha_ = 0.0;
+
+  cv::Mat newCameraMatrix_;
+  cv::Mat map1_, map2_;
+  double buildMs_ = 0.0;
+};
+
+// Undistorts `frame` `iterations` times each with the per-frame
+// cv::undistort() (fisheye::undistortImage()), remap() with float maps and
+// remap() with the fixed-point maps, all producing the same view, and
+// prints time per frame, frame rate, map size and how far the fixed-point
+// result is from the per-frame one.
+void benchmarkUndistortion(const cv::Mat &frame, const cv::Mat &cameraMatrix,
+                           const cv::Mat &distCoeffs, bool fisheye,
+                           int iterations, std::ostream &os);
@@ -67,6 +67,66 @@ def main():
     stats["reproj_mean"] = summarize_series(
         df["reproj_mean"].replace(-1, np.nan).dropna(), "reproj_mean"
     )
+    # Frames discarded by the latest-frame capture front-end before each
+    # logged frame (column missing in logs from older builds)
+    if "dropped" in df.columns:
+        stats["dropped"] = summarize_series(df["dropped"], "dropped")
+    # Corner detection time split by how the corners were found
+    # (full-frame search, ROI around the previous board, ...)
+    if "detect_mode" in df.columns:
+        for mode, group in df.groupby("detect_mode"):
+            stats[f"detect_ms_{mode}"] = summarize_series(
+                group["detect_ms"], f"detect_ms_{mode}"
+            )
+    # Coarse-to-fine detection: cost and accuracy per pyramid level
+    if "pyr_level" in df.columns:
+        detected = df[df["pyr_level"] >= 0]
+        for level, group in detected.groupby("pyr_level"):
+            stats[f"detect_ms_level{level}"] = summarize_series(
+                group["detect_ms"], f"detect_ms_level{level}"
+            )
+            stats[f"reproj_mean_level{level}"] = summarize_series(
+                group["reproj_mean"], f"reproj_mean_level{level}"
+            )
+    # GPU work per frame from timer queries (upload, then everything drawn)
+    if "gpu_upload_ms" in df.columns:
+        stats["gpu_upload_ms"] = summarize_series(
+            df["gpu_upload_ms"], "gpu_upload_ms"
+        )
+        stats["gpu_draw_ms"] = summarize_series(df["gpu_draw_ms"], "gpu_draw_ms")
+        stats["gpu_done_after_swap"] = summarize_series(
+            df["gpu_done_ms"] - df["swap_ms"], "gpu_done_after_swap"
+        )
+    # CPU side of the texture upload and how many staging buffers were busy
+    if "upload_cpu_ms" in df.columns:
+        stats["upload_cpu_ms"] = summarize_series(
+            df["upload_cpu_ms"], "upload_cpu_ms"
+        )
+        stats["pbo_in_flight"] = summarize_series(
+            df["pbo_in_flight"], "pbo_in_flight"
+        )
+    # BGR -> RGB + flip on the CPU (cpu mode) or what skipping it saves
+    # (shader mode, estimated from sampled conversions)
+    if "convert_ms" in df.columns:
+        stats["convert_ms"] = summarize_series(df["convert_ms"], "convert_ms")
+        stats["convert_saved_ms"] = summarize_series(
+            df["convert_saved_ms"], "convert_saved_ms"
+        )
+    # Per-stage breakdown from the scoped timers
+    for col in ["gray_ms", "subpix_ms", "reproj_ms", "imgui_ms", "draw_cpu_ms"]:
+        if col in df.columns:
+            stats[col] = summarize_series(df[col], col)
+    # Detection cost per latency-budget quality rung (-1: no budget)
+    if "quality_level" in df.columns and (df["quality_level"] >= 0).any():
+        for level, group in df[df["quality_level"] >= 0].groupby("quality_level"):
+            stats[f"detect_ms_quality{level}"] = summarize_series(
+                group["detect_ms"], f"detect_ms_quality{level}"
+            )
+    # Pose solver time, only meaningful on frames where the board was found
+    if "pose_ms" in df.columns:
+        stats["pose_ms"] = summarize_series(
+            df.loc[df["found"] == 1, "pose_ms"], "pose_ms"
+        )
 
     print("Summary statistics:\n")
     for k, v in stats.items():
@@ -74,6 +134,9 @@ def main():
             f"{k}: count={v['count']} mean={v['mean']:.3f} median={v['median']:.3f} std={v['std']:.3f} min={v['min']:.3f} max={v['max']:.3f} p90={v['p90']:.3f}"
         )
 
+    if "dropped" in df.columns:
+        print(f"\nDropped frames total: {int(df['dropped'].sum())}")
+
     # Save textual summary
     with open(outdir / "summary.txt", "w") as fh:
         for k, v in stats.items():